@@ -0,0 +1,66 @@
+#include "allocations.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions, the array and nothrow forms call these
+static thread_local uint64_t allocations = 0;
+
+uint64_t threadAllocations() {
+	return allocations;
+}
+
+// Like the standard operator new: on failure the new handler may free memory and have it retried
+template<typename Allocate>
+static void* allocate(Allocate tryAllocate) {
+	allocations++;
+	while (true) {
+		if (void* memory = tryAllocate()) {
+			return memory;
+		}
+		auto handler = std::get_new_handler();
+		if (!handler) {
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+void* operator new(std::size_t size) {
+	return allocate([size]() {
+		return std::malloc(std::max<std::size_t>(size, 1));
+	});
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	return allocate([size, alignment]() {
+		auto bytes = std::max<std::size_t>(size, 1);
+#ifdef _WIN32
+		return _aligned_malloc(bytes, (std::size_t)alignment);
+#else
+		// The size has to be a multiple of the alignment
+		auto align = (std::size_t)alignment;
+		return std::aligned_alloc(align, (bytes + align - 1) / align * align);
+#endif
+	});
+}
+
+void operator delete(void* memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t alignment) noexcept {
+	operator delete(memory, alignment);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocations made through operator new by the calling thread so far. Counted per thread, so
+// a thread can tell its own allocations in a stretch of work apart from everyone else's.
+uint64_t threadAllocations();
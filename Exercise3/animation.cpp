@@ -1,48 +1,68 @@
 #include "animation.h"
 
-Animation::Animation(const std::string& name, const sf::Texture& source, vec2 frameSize, int delay)
+AnimationClip::AnimationClip(const std::string& name, uint32_t id, const sf::Texture* texture, uint32_t textureId, vec2 frameSize, int length, int delay)
 	: name(name)
-	, sprite(source, sf::IntRect(vec2::zero(), frameSize))
-	, size(frameSize)
-	, length(source.getSize().x / frameSize.x)
+	, id(id)
+	, texture(texture)
+	, textureId(textureId)
+	, frameSize(frameSize)
+	, length(length)
 	, delay(delay) {
-	sprite.setOrigin(frameSize / 2);
-	updateSprite();
 }
 
-void Animation::update()
+sf::IntRect AnimationClip::getFrameRect(int index) const
 {
-	timer++;
-	if (timer > delay) {
-		timer = 0;
-		if (index < length) {
-			index++;
-			updateSprite();
-		}
+	// Past the end the animation holds its last frame
+	if (index >= length) {
+		index = length - 1;
 	}
+	return sf::IntRect(index * frameSize.x, 0, frameSize.x, frameSize.y);
+}
+
+int AnimationClip::getLoopIndex(float time) const
+{
+	if (length <= 1) {
+		return 0;
+	}
+	// Each frame lasts delay + 1 frames, matching Animation::update()
+	return (int)(time / (delay + 1)) % length;
+}
+
+void Animation::play(const AnimationClip& clip)
+{
+	this->clip = &clip;
+	reset();
+}
+
+void Animation::update(float frames)
+{
+	// Each frame lasts delay + 1 frames, the time left over carries into the next one
+	// so animations play at the same speed whatever the tick rate
+	timer += frames;
+	while (timer >= clip->delay + 1 && index < clip->length) {
+		timer -= clip->delay + 1;
+		index++;
+	}
+}
+
+void Animation::seek(int index, float timer)
+{
+	this->index = index;
+	this->timer = timer;
 }
 
 void Animation::reset()
 {
 	index = 0;
 	timer = 0;
-	updateSprite();
 }
 
 bool Animation::hasEnded() const
 {
-	return (index >= length);
+	return (index >= clip->length);
 }
 
-const sf::Sprite& Animation::getSprite() const
+sf::IntRect Animation::getFrameRect() const
 {
-	return sprite;
-}
-
-void Animation::updateSprite()
-{
-	if (index >= 0 && index < length) {
-		auto rect = sf::IntRect(index * size.x, 0, size.x, size.y);
-		sprite.setTextureRect(rect);
-	}
+	return clip->getFrameRect(index);
 }
@@ -1,29 +1,52 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <SFML/Graphics.hpp>
 #include "geometry.h"
 
+// Immutable animation data, owned by Assets and shared by every entity that plays it
+struct AnimationClip
+{
+	AnimationClip() = default;
+	AnimationClip(const std::string& name, uint32_t id, const sf::Texture* texture, uint32_t textureId, vec2 frameSize, int length, int delay);
+
+	std::string name;
+	uint32_t id = 0; // dense index, unique per clip
+	const sf::Texture* texture = nullptr; // null without graphics
+	uint32_t textureId = 0;
+	vec2 frameSize;
+	int length = 1;
+	int delay = 0;
+
+	sf::IntRect getFrameRect(int index) const;
+	// Frame shown at the given time when looping without any per-entity state
+	int getLoopIndex(float time) const;
+};
+
+// Playback position within a clip, cheap to copy and free to create
 class Animation
 {
 public:
 	Animation() = default;
-	Animation(const std::string& name, const sf::Texture& source, vec2 frameSize, int delay);
-	const std::string& getName() const { return name; };
-	const vec2& getSize() const { return size; };
-	void update();
+	void play(const AnimationClip& clip);
+	// Advances the animation by the given number of (reference) frames
+	void update(float frames = 1.0f);
 	void reset();
 	bool hasEnded() const;
 
-	const sf::Sprite& getSprite() const;
+	bool hasClip() const { return clip != nullptr; }
+	const AnimationClip& getClip() const { return *clip; };
+	const vec2& getSize() const { return clip->frameSize; };
+	uint32_t getTextureId() const { return clip->textureId; };
+	sf::IntRect getFrameRect() const;
 
-private:
-	void updateSprite();
+	// Playback position, for saving and restoring it
+	int getIndex() const { return index; }
+	float getTimer() const { return timer; }
+	void seek(int index, float timer);
 
-	std::string name;
-	sf::Sprite sprite;
-	vec2 size;
-	int length = 1;
+private:
+	const AnimationClip* clip = nullptr;
 	int index = 0;
-	int delay = 0;
-	int timer = 0;
+	float timer = 0;
 };
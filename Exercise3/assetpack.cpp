@@ -0,0 +1,195 @@
+#include "assetpack.h"
+#include "assets.h"
+#include "parser.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+	class PackWriter
+	{
+	public:
+		PackString addString(const std::string& text) {
+			PackString result;
+			result.offset = (uint32_t)append(text.data(), text.size(), 1);
+			result.length = (uint32_t)text.size();
+			return result;
+		}
+
+		uint64_t append(const void* bytes, size_t size, size_t alignment) {
+			size_t offset = (data.size() + alignment - 1) / alignment * alignment;
+			data.resize(offset + size);
+			std::memcpy(data.data() + offset, bytes, size);
+			return offset;
+		}
+
+		template<typename T>
+		void write(std::ofstream& file, const std::vector<T>& records) {
+			file.write((const char*)records.data(), records.size() * sizeof(T));
+		}
+
+		std::vector<uint8_t> data;
+	};
+
+	std::vector<char> readFile(const fs::path& path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to open " + path.string());
+		}
+		return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+}
+
+void bakeAssetPack(const std::string& resourcesPath, const std::string& outputPath) {
+	fs::path dir(resourcesPath);
+	fs::path outputDir = fs::absolute(outputPath).parent_path();
+
+	PackWriter writer;
+	std::vector<PackTexture> textures;
+	std::vector<PackAnimation> animations;
+	std::vector<PackFont> fonts;
+	std::vector<PackLevel> levels;
+	std::vector<PackSound> sounds;
+	std::vector<PackMusic> music;
+	std::vector<std::string> textureNames;
+
+	parser_map parsers;
+	parsers["Texture"] = [&](auto instruction, auto& line) {
+		TextureConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty texture config");
+		}
+		sf::Image image;
+		if (!image.loadFromFile((dir / config.path).string())) {
+			throw std::runtime_error("Failed to load texture '" + config.name + "' from " + config.path);
+		}
+		PackTexture record;
+		record.name = writer.addString(config.name);
+		record.width = image.getSize().x;
+		record.height = image.getSize().y;
+		record.pixels = writer.append(image.getPixelsPtr(), (size_t)record.width * record.height * 4, 16);
+		textures.push_back(record);
+		textureNames.push_back(config.name);
+	};
+	parsers["Animation"] = [&](auto instruction, auto& line) {
+		AnimationConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty animation config");
+		}
+		auto texture = std::find(textureNames.begin(), textureNames.end(), config.texture);
+		if (texture == textureNames.end()) {
+			throw MissingAssetException("Texture", config.texture);
+		}
+		PackAnimation record;
+		record.name = writer.addString(config.name);
+		record.texture = (uint32_t)std::distance(textureNames.begin(), texture);
+		record.length = config.length;
+		record.delay = config.delay;
+		record.reserved = 0;
+		animations.push_back(record);
+	};
+	parsers["Font"] = [&](auto instruction, auto& line) {
+		FontConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty font config");
+		}
+		auto bytes = readFile(dir / config.path);
+		PackFont record;
+		record.name = writer.addString(config.name);
+		record.data = writer.append(bytes.data(), bytes.size(), 16);
+		record.size = bytes.size();
+		fonts.push_back(record);
+	};
+	parsers["Level"] = [&](auto instruction, auto& line) {
+		// Levels stay separate files, the pack only records where they are
+		LevelConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty level config");
+		}
+		PackLevel record;
+		record.name = writer.addString(config.name);
+		record.path = writer.addString(fs::absolute(dir / config.path).lexically_relative(outputDir).generic_string());
+		levels.push_back(record);
+	};
+	parsers["Sound"] = [&](auto instruction, auto& line) {
+		SoundConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty sound config");
+		}
+		auto bytes = readFile(dir / config.path);
+		PackSound record;
+		record.name = writer.addString(config.name);
+		record.data = writer.append(bytes.data(), bytes.size(), 16);
+		record.size = bytes.size();
+		record.priority = config.priority;
+		record.volume = config.volume;
+		sounds.push_back(record);
+	};
+	parsers["Music"] = [&](auto instruction, auto& line) {
+		MusicConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty music config");
+		}
+		PackMusic record;
+		record.name = writer.addString(config.name);
+		record.path = writer.addString(fs::absolute(dir / config.path).lexically_relative(outputDir).generic_string());
+		music.push_back(record);
+	};
+	generic_parser((dir / "assets.txt").string(), parsers, [](auto instruction, auto& line) {
+		std::cout << "Unknown instruction type: " << std::quoted(std::string(instruction)) << std::endl;
+	});
+
+	PackHeader header;
+	header.magic = packMagic;
+	header.version = packVersion;
+	header.textureCount = (uint32_t)textures.size();
+	header.animationCount = (uint32_t)animations.size();
+	header.fontCount = (uint32_t)fonts.size();
+	header.levelCount = (uint32_t)levels.size();
+	header.soundCount = (uint32_t)sounds.size();
+	header.musicCount = (uint32_t)music.size();
+	header.dataOffset = sizeof(PackHeader)
+		+ textures.size() * sizeof(PackTexture)
+		+ animations.size() * sizeof(PackAnimation)
+		+ fonts.size() * sizeof(PackFont)
+		+ levels.size() * sizeof(PackLevel)
+		+ sounds.size() * sizeof(PackSound)
+		+ music.size() * sizeof(PackMusic);
+	// Data section starts 16 byte aligned so the pixel offsets stay aligned in the file
+	size_t padding = (16 - header.dataOffset % 16) % 16;
+	header.dataOffset += padding;
+	header.dataSize = writer.data.size();
+
+	std::ofstream file(outputPath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to create " + outputPath);
+	}
+	file.write((const char*)&header, sizeof(header));
+	writer.write(file, textures);
+	writer.write(file, animations);
+	writer.write(file, fonts);
+	writer.write(file, levels);
+	writer.write(file, sounds);
+	writer.write(file, music);
+	const char zeros[16] = {};
+	file.write(zeros, padding);
+	file.write((const char*)writer.data.data(), writer.data.size());
+	if (!file.good()) {
+		throw std::runtime_error("Failed to write " + outputPath);
+	}
+
+	std::cout << "Baked " << textures.size() << " textures, "
+		<< animations.size() << " animations, "
+		<< fonts.size() << " fonts, "
+		<< levels.size() << " levels, "
+		<< sounds.size() << " sounds and "
+		<< music.size() << " music tracks into " << std::quoted(outputPath)
+		<< " (" << header.dataOffset + header.dataSize << " bytes)" << std::endl;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// Binary asset pack, written by bakeAssetPack() and memory mapped by Assets::loadPack().
+// Layout: PackHeader, the six record tables back to back, then the data section.
+// All offsets in records are relative to the start of the data section.
+
+constexpr uint32_t packMagic = 0x4B504133; // "3APK" read as little endian
+constexpr uint32_t packVersion = 2;
+
+struct PackString
+{
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct PackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t textureCount;
+	uint32_t animationCount;
+	uint32_t fontCount;
+	uint32_t levelCount;
+	uint32_t soundCount;
+	uint32_t musicCount;
+	uint64_t dataOffset; // from the start of the file
+	uint64_t dataSize;
+};
+
+struct PackTexture
+{
+	PackString name;
+	uint32_t width;
+	uint32_t height;
+	uint64_t pixels; // width * height RGBA8 pixels, 16 byte aligned
+};
+
+struct PackAnimation
+{
+	PackString name;
+	uint32_t texture; // index into the texture table
+	int32_t length;
+	int32_t delay;
+	uint32_t reserved; // keeps the record size a multiple of 8
+};
+
+struct PackFont
+{
+	PackString name;
+	uint64_t data; // the font file as is
+	uint64_t size;
+};
+
+struct PackLevel
+{
+	PackString name;
+	PackString path; // relative to the directory of the pack
+};
+
+struct PackSound
+{
+	PackString name;
+	uint64_t data; // the sound file as is, decoded when the pack is loaded
+	uint64_t size;
+	int32_t priority;
+	float volume;
+};
+
+// Music is streamed, so like levels it stays a separate file
+struct PackMusic
+{
+	PackString name;
+	PackString path; // relative to the directory of the pack
+};
+
+// Records are read in place from the mapping, so every table has to stay 8 byte aligned
+template<typename T>
+constexpr bool isPackRecord = std::is_trivially_copyable_v<T> && sizeof(T) % 8 == 0;
+static_assert(isPackRecord<PackHeader> && isPackRecord<PackTexture> && isPackRecord<PackAnimation>, "Invalid pack record layout");
+static_assert(isPackRecord<PackFont> && isPackRecord<PackLevel>, "Invalid pack record layout");
+static_assert(isPackRecord<PackSound> && isPackRecord<PackMusic>, "Invalid pack record layout");
+
+// Decodes everything listed in <resourcesPath>/assets.txt and writes it to a single pack
+void bakeAssetPack(const std::string& resourcesPath, const std::string& outputPath);
@@ -1,116 +1,608 @@
 #include "assets.h"
+#include "assetpack.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
 #include <fstream>
+#include <future>
 #include <filesystem>
 #include <iostream>
-#include <sstream>
 
 namespace fs = std::filesystem;
 
+// Reads the dimensions from the PNG header, other formats are decoded in full
+static bool readImageSize(const std::string& file, vec2& size) {
+	std::ifstream stream(file, std::ios::binary);
+	uint8_t header[24];
+	if (stream.read((char*)header, sizeof(header)) && std::memcmp(header, "\x89PNG\r\n\x1a\n", 8) == 0 && std::memcmp(header + 12, "IHDR", 4) == 0) {
+		auto bigEndian = [&](int offset) {
+			return (uint32_t)header[offset] << 24 | (uint32_t)header[offset + 1] << 16 | (uint32_t)header[offset + 2] << 8 | header[offset + 3];
+		};
+		size = vec2((float)bigEndian(16), (float)bigEndian(20));
+		return true;
+	}
+	sf::Image image;
+	if (!image.loadFromFile(file)) {
+		return false;
+	}
+	size = image.getSize();
+	return true;
+}
+
 void Assets::loadResources(const std::string& basePath) {
+	ProfileZone zone("Assets::loadResources");
 	std::cout << "Loading resources from " << std::quoted(basePath) << std::endl;
 	fs::path dir(basePath);
+	if (loadGraphics) {
+		pool = std::make_unique<ThreadPool>();
+	}
+	resourcesPath = basePath;
+	auto addSource = [this](const std::string& path, AssetChange::Type type, uint32_t index) {
+		AssetChange source;
+		source.type = type;
+		source.index = index;
+		sources[fs::path(path).lexically_normal().generic_string()] = source;
+	};
 
-	// Open assets file
-	std::ifstream file(dir / "assets.txt");
-	if (!file.is_open()) {
-		throw std::exception("Failed to open assets file");
-	}
-
-	// Parse line-by-line
-	std::string lineText;
-	while (file.good() && std::getline(file, lineText)) {
-		std::istringstream line(lineText);
-		std::string instruction;
-		// Check for reasons to skip the line
-		if (
-			!(line >> instruction) || // line is empty
-			(instruction[0] == '#') // line is comment (starts with #)
-		) {
-			continue;
+	parser_map parsers;
+	parsers["Texture"] = [&](auto instruction, auto& line) {
+		TextureConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty texture config");
 		}
-		// Handle instruction types
-		if (instruction == "Texture") {
-			TextureConfig config;
-			line >> config;
-			auto& texture = textures[config.name];
-			if (texture.loadFromFile((dir / config.path).string())) {
-				auto size = texture.getSize();
-				std::cout << "Loaded texture " << std::quoted(config.path) << " as " << std::quoted(config.name) << " (" << size.x << "x" << size.y << ")" << std::endl;
-			} else {
-				throw std::runtime_error("Failed to load texture '" + config.name + "' from " + config.path);
-			}
-		} else if (instruction == "Animation") {
-			AnimationConfig config;
-			line >> config;
-			const sf::Texture& texture = getTexture(config.texture);
-			auto size = texture.getSize();
-			animations[config.name] = Animation(config.name, texture, vec2(size.x / config.length, size.y), config.delay);
-			std::cout << "Loaded animation " << std::quoted(config.name) << " using " << std::quoted(config.texture) << ", " << config.length << " frames" << std::endl;
-		} else if (instruction == "Font") {
-			FontConfig config;
-			line >> config;
-			sf::Font& font = fonts[config.name];
-			if (font.loadFromFile((dir / config.path).string())) {
-				std::cout << "Loaded font " << std::quoted(config.name) << " from " << std::quoted(config.path) << std::endl;
-			} else {
-				throw std::runtime_error("Failed to load font '" + config.name + "' from " + config.path);
-			}
-		} else if (instruction == "Level") {
-			LevelConfig config;
-			line >> config;
-			config.path = (dir / config.path).string();
-			levels[config.name] = config;
-			std::cout << "Registered level " << std::quoted(config.name) << " as " << std::quoted(config.path) << std::endl;
+		auto handle = textures.insert(config.name);
+		auto file = (dir / config.path).string();
+		vec2 size;
+		if (!readImageSize(file, size)) {
+			throw std::runtime_error("Failed to load texture '" + config.name + "' from " + config.path);
+		}
+		registerTexture(handle, size, file, nullptr);
+		addSource(config.path, AssetChange::Type::Texture, handle.index);
+		std::cout << "Registered texture " << std::quoted(config.path) << " as " << std::quoted(config.name) << " (" << size.x << "x" << size.y << ")" << std::endl;
+	};
+	parsers["Animation"] = [&](auto instruction, auto& line) {
+		AnimationConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty animation config");
+		}
+		auto textureHandle = findTexture(config.texture);
+		auto& texture = textures[textureHandle];
+		auto handle = animations.insert(config.name);
+		animations[handle] = AnimationClip(config.name, handle.index, texture.texture.get(), textureHandle.index, vec2(floorf(texture.size.x / config.length), texture.size.y), config.length, config.delay);
+		std::cout << "Registered animation " << std::quoted(config.name) << " using " << std::quoted(config.texture) << ", " << config.length << " frames" << std::endl;
+	};
+	parsers["Font"] = [&](auto instruction, auto& line) {
+		FontConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty font config");
+		}
+		auto handle = fonts.insert(config.name);
+		addSource(config.path, AssetChange::Type::Font, handle.index);
+		sf::Font& font = fonts[handle];
+		if (font.loadFromFile((dir / config.path).string())) {
+			std::cout << "Loaded font " << std::quoted(config.name) << " from " << std::quoted(config.path) << std::endl;
 		} else {
-			std::cout << "Unknown instruction type: " << std::quoted(instruction) << std::endl;
+			throw std::runtime_error("Failed to load font '" + config.name + "' from " + config.path);
+		}
+	};
+	parsers["Level"] = [&](auto instruction, auto& line) {
+		LevelConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty level config");
+		}
+		auto handle = levels.insert(config.name);
+		addSource(config.path, AssetChange::Type::Level, handle.index);
+		config.path = (dir / config.path).string();
+		levels[handle] = config;
+		std::cout << "Registered level " << std::quoted(config.name) << " as " << std::quoted(config.path) << std::endl;
+	};
+	parsers["Sound"] = [&](auto instruction, auto& line) {
+		SoundConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty sound config");
+		}
+		auto handle = sounds.insert(config.name);
+		addSource(config.path, AssetChange::Type::Sound, handle.index);
+		auto& sound = sounds[handle];
+		sound.priority = config.priority;
+		sound.volume = config.volume;
+		if (loadGraphics && !sound.buffer.loadFromFile((dir / config.path).string())) {
+			throw std::runtime_error("Failed to load sound '" + config.name + "' from " + config.path);
 		}
+		std::cout << "Loaded sound " << std::quoted(config.name) << " from " << std::quoted(config.path) << std::endl;
+	};
+	parsers["Music"] = [&](auto instruction, auto& line) {
+		MusicConfig config;
+		if (!(line >> config)) {
+			throw line.error("Assets included faulty music config");
+		}
+		// Streamed from the file while playing, nothing is loaded up front
+		config.path = (dir / config.path).string();
+		music[music.insert(config.name)] = config;
+		std::cout << "Registered music " << std::quoted(config.name) << " as " << std::quoted(config.path) << std::endl;
+	};
+	generic_parser((dir / "assets.txt").string(), parsers, [](auto instruction, auto& line) {
+		std::cout << "Unknown instruction type: " << std::quoted(std::string(instruction)) << std::endl;
+	});
+	std::cout << "Assets registered ("
+		<< textures.size() << " textures, "
+		<< animations.size() << " animations, "
+		<< fonts.size() << " fonts, "
+		<< levels.size() << " levels, "
+		<< sounds.size() << " sounds, "
+		<< music.size() << " music tracks)"
+		<< std::endl;
+}
+
+void Assets::loadPack(const std::string& path) {
+	ProfileZone zone("Assets::loadPack");
+	std::cout << "Loading asset pack " << std::quoted(path) << std::endl;
+	pack = MappedFile(path);
+	fs::path dir = fs::path(path).parent_path();
+
+	auto corrupt = [&]() {
+		return std::runtime_error("Asset pack " + path + " is corrupt or from another version");
+	};
+	if (pack.size() < sizeof(PackHeader)) {
+		throw corrupt();
+	}
+	auto& header = *(const PackHeader*)pack.data();
+	if (header.magic != packMagic || header.version != packVersion || header.dataOffset > pack.size() || header.dataSize > pack.size() - header.dataOffset) {
+		throw corrupt();
 	}
-	std::cout << "Assets loaded ("
+	uint64_t tablesSize = (uint64_t)header.textureCount * sizeof(PackTexture)
+		+ (uint64_t)header.animationCount * sizeof(PackAnimation)
+		+ (uint64_t)header.fontCount * sizeof(PackFont)
+		+ (uint64_t)header.levelCount * sizeof(PackLevel)
+		+ (uint64_t)header.soundCount * sizeof(PackSound)
+		+ (uint64_t)header.musicCount * sizeof(PackMusic);
+	if (sizeof(PackHeader) + tablesSize > header.dataOffset) {
+		throw corrupt();
+	}
+
+	// Records and data are used in place, nothing is copied out of the mapping except names
+	const uint8_t* data = pack.data() + header.dataOffset;
+	auto checkRange = [&](uint64_t offset, uint64_t size) {
+		if (offset > header.dataSize || size > header.dataSize - offset) {
+			throw corrupt();
+		}
+	};
+	auto text = [&](PackString string) {
+		checkRange(string.offset, string.length);
+		return std::string((const char*)data + string.offset, string.length);
+	};
+	auto packTextures = (const PackTexture*)(pack.data() + sizeof(PackHeader));
+	auto packAnimations = (const PackAnimation*)(packTextures + header.textureCount);
+	auto packFonts = (const PackFont*)(packAnimations + header.animationCount);
+	auto packLevels = (const PackLevel*)(packFonts + header.fontCount);
+	auto packSounds = (const PackSound*)(packLevels + header.levelCount);
+	auto packMusic = (const PackMusic*)(packSounds + header.soundCount);
+
+	std::vector<TextureHandle> textureHandles;
+	textureHandles.reserve(header.textureCount);
+	for (uint32_t i = 0; i < header.textureCount; i++) {
+		auto& record = packTextures[i];
+		checkRange(record.pixels, (uint64_t)record.width * record.height * 4);
+		auto handle = textures.insert(text(record.name));
+		registerTexture(handle, vec2(record.width, record.height), "", data + record.pixels);
+		textureHandles.push_back(handle);
+	}
+
+	for (uint32_t i = 0; i < header.animationCount; i++) {
+		auto& record = packAnimations[i];
+		if (record.texture >= textureHandles.size() || record.length <= 0) {
+			throw corrupt();
+		}
+		auto textureHandle = textureHandles[record.texture];
+		auto& texture = textures[textureHandle];
+		std::string name = text(record.name);
+		auto handle = animations.insert(name);
+		animations[handle] = AnimationClip(name, handle.index, texture.texture.get(), textureHandle.index, vec2(floorf(texture.size.x / record.length), texture.size.y), record.length, record.delay);
+	}
+
+	for (uint32_t i = 0; i < header.fontCount; i++) {
+		auto& record = packFonts[i];
+		checkRange(record.data, record.size);
+		auto handle = fonts.insert(text(record.name));
+		// SFML reads the font from this memory for as long as it lives, the mapping is kept open for that
+		if (!fonts[handle].loadFromMemory(data + record.data, (size_t)record.size)) {
+			throw std::runtime_error("Failed to load font '" + fonts.getName(handle) + "' from pack");
+		}
+	}
+
+	for (uint32_t i = 0; i < header.levelCount; i++) {
+		auto& record = packLevels[i];
+		LevelConfig config;
+		config.name = text(record.name);
+		config.path = (dir / text(record.path)).string();
+		levels[levels.insert(config.name)] = config;
+	}
+
+	for (uint32_t i = 0; i < header.soundCount; i++) {
+		auto& record = packSounds[i];
+		checkRange(record.data, record.size);
+		auto handle = sounds.insert(text(record.name));
+		auto& sound = sounds[handle];
+		sound.priority = record.priority;
+		sound.volume = record.volume;
+		// Decoded into the buffer, unlike fonts the mapping isn't needed afterwards
+		if (loadGraphics && !sound.buffer.loadFromMemory(data + record.data, (size_t)record.size)) {
+			throw std::runtime_error("Failed to load sound '" + sounds.getName(handle) + "' from pack");
+		}
+	}
+
+	for (uint32_t i = 0; i < header.musicCount; i++) {
+		auto& record = packMusic[i];
+		MusicConfig config;
+		config.name = text(record.name);
+		config.path = (dir / text(record.path)).string();
+		music[music.insert(config.name)] = config;
+	}
+
+	std::cout << "Assets registered from pack ("
 		<< textures.size() << " textures, "
 		<< animations.size() << " animations, "
 		<< fonts.size() << " fonts, "
-		<< levels.size() << " levels)"
+		<< levels.size() << " levels, "
+		<< sounds.size() << " sounds, "
+		<< music.size() << " music tracks)"
 		<< std::endl;
 }
 
-const sf::Texture& Assets::getTexture(const std::string& name) const {
-	try {
-		return textures.at(name);
-	} catch (std::out_of_range& exception) {
-		throw MissingAssetException("Texture", name);
+void Assets::registerTexture(TextureHandle handle, vec2 size, const std::string& file, const uint8_t* packedPixels) {
+	textures[handle].size = size;
+	if (loadGraphics && !textures[handle].texture) {
+		textures[handle].texture = std::make_unique<sf::Texture>();
 	}
+	std::lock_guard<std::mutex> lock(residencyMutex);
+	residency.resize(textures.size());
+	auto& state = residency[handle.index];
+	state.file = file;
+	state.packedPixels = packedPixels;
 }
 
-const sf::Font& Assets::getFont(const std::string& name) const
-{
-	try {
-		return fonts.at(name);
-	} catch (std::out_of_range& exception) {
-		throw MissingAssetException("Font", name);
+void Assets::retain(TextureHandle handle) const {
+	std::lock_guard<std::mutex> lock(residencyMutex);
+	auto& state = residency[handle.index];
+	if (state.references++ > 0) {
+		return;
+	}
+	if (state.unused) {
+		unusedTextures.erase(state.unusedEntry);
+		state.unused = false;
+	}
+	if (state.resident || state.loading) {
+		return;
+	}
+
+	auto& asset = textures[handle];
+	if (!loadGraphics) {
+		// Sizes are all that's needed without a window
+		state.resident = true;
+		asset.ready.store(true, std::memory_order_release);
+		return;
+	}
+
+	state.loading = true;
+	loadingTextures.push_back(handle.index);
+	queuedLoads++;
+	if (state.packedPixels == nullptr) {
+		state.image = pool->submit([file = state.file]() {
+			// Decoding is CPU only, the texture is created later on the owning thread
+			ProfileZone zone("Decode texture");
+			sf::Image image;
+			if (!image.loadFromFile(file)) {
+				throw std::runtime_error("Failed to load texture from " + file);
+			}
+			return image;
+		});
 	}
 }
 
-const Animation& Assets::getAnimation(const std::string& name) const {
-	try {
-		return animations.at(name);
-	} catch (std::out_of_range& exception) {
-		throw MissingAssetException("Animation", name);
+void Assets::release(TextureHandle handle) const {
+	std::lock_guard<std::mutex> lock(residencyMutex);
+	auto& state = residency[handle.index];
+	assert(state.references > 0);
+	if (--state.references == 0 && state.resident) {
+		unusedTextures.push_front(handle.index);
+		state.unusedEntry = unusedTextures.begin();
+		state.unused = true;
+	}
+}
+
+void Assets::update() {
+	std::lock_guard<std::mutex> lock(residencyMutex);
+	size_t uploaded = 0;
+	for (auto it = loadingTextures.begin(); it != loadingTextures.end(); ) {
+		auto& state = residency[*it];
+		if (state.image.valid() && state.image.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			++it;
+			continue;
+		}
+		upload(TextureHandle{ *it }, state);
+		uploaded++;
+		it = loadingTextures.erase(it);
+	}
+	evict();
+
+	if (uploaded > 0 && onProgress) {
+		LoadProgress progress;
+		progress.loaded = completedLoads;
+		progress.total = queuedLoads;
+		onProgress(progress);
+	}
+	if (loadingTextures.empty()) {
+		// Progress covers one burst of loads
+		queuedLoads = 0;
+		completedLoads = 0;
 	}
 }
 
-const LevelConfig& Assets::getLevel(const std::string& name) const {
+void Assets::upload(TextureHandle handle, TextureResidency& state) {
+	ProfileZone zone("Upload texture");
+	auto& asset = textures[handle];
 	try {
-		return levels.at(name);
-	} catch (std::out_of_range& exception) {
-		throw MissingAssetException("Level", name);
+		if (state.packedPixels) {
+			if (!asset.texture->create((unsigned)asset.size.x, (unsigned)asset.size.y)) {
+				throw std::runtime_error("Failed to create texture '" + textures.getName(handle) + "'");
+			}
+			asset.texture->update(state.packedPixels);
+		} else {
+			// Rethrows decoding errors on the owning thread
+			sf::Image image = state.image.get();
+			if (!asset.texture->loadFromImage(image)) {
+				throw std::runtime_error("Failed to create texture '" + textures.getName(handle) + "'");
+			}
+		}
+	} catch (const std::exception& error) {
+		// A missing or broken file doesn't stop the game, the texture stays empty and the renderer skips it.
+		// It counts as loaded so nobody waits for it, a hot reload of the file can still fix it.
+		std::cout << "Failed to load texture " << std::quoted(textures.getName(handle)) << ", drawing it empty: " << error.what() << std::endl;
+		*asset.texture = sf::Texture();
+	}
+	auto size = asset.texture->getSize();
+	residentBytes += (size_t)size.x * size.y * 4;
+	state.loading = false;
+	state.resident = true;
+	completedLoads++;
+	if (state.references == 0) {
+		// Released while loading, keep it around in case it's wanted again
+		unusedTextures.push_front(handle.index);
+		state.unusedEntry = unusedTextures.begin();
+		state.unused = true;
+	}
+
+	// Publishes the texture to other threads
+	asset.ready.store(true, std::memory_order_release);
+}
+
+void Assets::evict() {
+	while (residentBytes > textureBudget && !unusedTextures.empty()) {
+		uint32_t index = unusedTextures.back();
+		unusedTextures.pop_back();
+		auto& state = residency[index];
+		state.unused = false;
+		state.resident = false;
+
+		auto& asset = textures[TextureHandle{ index }];
+		asset.ready.store(false, std::memory_order_release);
+		if (asset.texture) {
+			auto size = asset.texture->getSize();
+			residentBytes -= (size_t)size.x * size.y * 4;
+			// Sprites still in flight skip empty textures, see Renderer::draw
+			*asset.texture = sf::Texture();
+		}
+		std::cout << "Evicted texture " << std::quoted(textures.getName(TextureHandle{ index })) << ", " << residentBytes / 1024 << " KiB resident" << std::endl;
+	}
+}
+
+void Assets::setTextureBudget(size_t bytes) {
+	std::lock_guard<std::mutex> lock(residencyMutex);
+	textureBudget = bytes;
+}
+
+bool Assets::reloadFile(const std::string& path, AssetChange& change) {
+	auto source = sources.find(fs::path(path).lexically_normal().generic_string());
+	if (source == sources.end()) {
+		return false;
+	}
+	change = source->second;
+	auto file = (fs::path(resourcesPath) / path).string();
+
+	switch (change.type) {
+		case AssetChange::Type::Texture:
+		{
+			TextureHandle handle{ change.index };
+			// Decoded in full before anything changes, a half saved file keeps the old image
+			sf::Image image;
+			if (!image.loadFromFile(file)) {
+				std::cout << "Failed to reload texture " << std::quoted(path) << ", keeping the old one" << std::endl;
+				return false;
+			}
+			change.size = image.getSize();
+			// Textures neither loading nor resident read the new file when they are next loaded
+			std::lock_guard<std::mutex> lock(residencyMutex);
+			auto& state = residency[handle.index];
+			if (state.loading) {
+				// The decode in flight read the old file, the new image is uploaded instead
+				std::promise<sf::Image> decoded;
+				decoded.set_value(std::move(image));
+				state.image = decoded.get_future();
+			} else if (state.resident && loadGraphics) {
+				// Same sf::Texture object, so clips and sprites keep pointing at it
+				auto& texture = *textures[handle].texture;
+				auto oldSize = texture.getSize();
+				if (!texture.loadFromImage(image)) {
+					std::cout << "Failed to reload texture " << std::quoted(path) << ", keeping the old one" << std::endl;
+					return false;
+				}
+				// The budget counted the old size, eviction will take off the new one
+				auto newSize = texture.getSize();
+				residentBytes = residentBytes - (size_t)oldSize.x * oldSize.y * 4 + (size_t)newSize.x * newSize.y * 4;
+			}
+			std::cout << "Reloaded texture " << std::quoted(textures.getName(handle)) << " from " << std::quoted(path) << std::endl;
+			return true;
+		}
+		case AssetChange::Type::Font:
+		{
+			FontHandle handle{ change.index };
+			if (!fonts[handle].loadFromFile(file)) {
+				std::cout << "Failed to reload font " << std::quoted(path) << std::endl;
+				return false;
+			}
+			std::cout << "Reloaded font " << std::quoted(fonts.getName(handle)) << " from " << std::quoted(path) << std::endl;
+			return true;
+		}
+		case AssetChange::Type::Sound:
+		{
+			// Voices playing the old samples pick up the new buffer, SFML reattaches them
+			SoundHandle handle{ change.index };
+			if (loadGraphics && !sounds[handle].buffer.loadFromFile(file)) {
+				std::cout << "Failed to reload sound " << std::quoted(path) << std::endl;
+				return false;
+			}
+			std::cout << "Reloaded sound " << std::quoted(sounds.getName(handle)) << " from " << std::quoted(path) << std::endl;
+			return true;
+		}
+		case AssetChange::Type::Level:
+			// Levels are parsed by the scene playing them
+			std::cout << "Level " << std::quoted(levels.getName(LevelHandle{ change.index })) << " changed" << std::endl;
+			return true;
+	}
+	return false;
+}
+
+void Assets::applyChange(const AssetChange& change) {
+	if (change.type != AssetChange::Type::Texture) {
+		return;
+	}
+	auto& asset = textures[TextureHandle{ change.index }];
+	asset.size = change.size;
+	for (uint32_t index = 0; index < animations.size(); index++) {
+		auto& clip = animations[AnimationHandle{ index }];
+		if (clip.textureId == change.index) {
+			clip.frameSize = vec2(floorf(asset.size.x / clip.length), asset.size.y);
+		}
+	}
+}
+
+void Assets::setProgressCallback(std::function<void(const LoadProgress&)> callback) {
+	onProgress = std::move(callback);
+}
+
+bool Assets::isLoaded() const {
+	std::lock_guard<std::mutex> lock(residencyMutex);
+	return loadingTextures.empty();
+}
+
+LoadProgress Assets::getProgress() const {
+	std::lock_guard<std::mutex> lock(residencyMutex);
+	LoadProgress progress;
+	progress.loaded = completedLoads;
+	progress.total = queuedLoads;
+	return progress;
+}
+
+bool Assets::isReady(TextureHandle handle) const {
+	return textures[handle].ready.load(std::memory_order_acquire);
+}
+
+bool Assets::isReady(AnimationHandle handle) const {
+	return isReady(TextureHandle{ animations[handle].textureId });
+}
+
+template<typename T>
+AssetHandle<T> findOrThrow(const AssetTable<T>& table, const std::string& type, AssetName name) {
+	auto handle = table.find(name);
+	if (!handle.valid()) {
+		throw MissingAssetException(type, std::string(name.text));
 	}
+	return handle;
+}
+
+TextureHandle Assets::findTexture(AssetName name) const {
+	return findOrThrow(textures, "Texture", name);
+}
+
+FontHandle Assets::findFont(AssetName name) const {
+	return findOrThrow(fonts, "Font", name);
+}
+
+AnimationHandle Assets::findAnimation(AssetName name) const {
+	return findOrThrow(animations, "Animation", name);
+}
+
+LevelHandle Assets::findLevel(AssetName name) const {
+	return findOrThrow(levels, "Level", name);
+}
+
+vec2 Assets::getTextureSize(TextureHandle handle) const {
+	return textures[handle].size;
+}
+
+const sf::Font& Assets::getFont(FontHandle handle) const {
+	return fonts[handle];
+}
+
+const AnimationClip& Assets::getAnimation(AnimationHandle handle) const {
+	return animations[handle];
+}
+
+const LevelConfig& Assets::getLevel(LevelHandle handle) const {
+	return levels[handle];
+}
+
+SoundHandle Assets::findSound(AssetName name) const {
+	return sounds.find(name);
+}
+
+MusicHandle Assets::findMusic(AssetName name) const {
+	return music.find(name);
+}
+
+const SoundAsset& Assets::getSound(SoundHandle handle) const {
+	return sounds[handle];
+}
+
+const MusicConfig& Assets::getMusic(MusicHandle handle) const {
+	return music[handle];
 }
 
 const std::vector<std::string> Assets::getLevelNames() const
 {
 	std::vector<std::string> result;
-	for (auto& pair : levels) {
-		result.push_back(pair.first);
+	for (uint32_t index = 0; index < levels.size(); index++) {
+		result.push_back(levels.getName(LevelHandle{ index }));
 	}
 	return result;
 }
+
+void AssetReferences::set(std::vector<TextureHandle> handles) {
+	std::sort(handles.begin(), handles.end(), [](TextureHandle left, TextureHandle right) {
+		return left.index < right.index;
+	});
+	handles.erase(std::unique(handles.begin(), handles.end()), handles.end());
+	for (auto handle : handles) {
+		assets.retain(handle);
+	}
+	clear();
+	textures = std::move(handles);
+}
+
+void AssetReferences::clear() {
+	for (auto handle : textures) {
+		assets.release(handle);
+	}
+	textures.clear();
+}
+
+bool AssetReferences::ready() const {
+	for (auto handle : textures) {
+		if (!assets.isReady(handle)) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -1,14 +1,26 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <exception>
+#include <functional>
+#include <future>
 #include <map>
+#include <memory>
 #include <string>
-#include <istream>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <exception>
+#include <vector>
 #include <SFML/Audio.hpp>
 #include <SFML/Graphics.hpp>
 #include "animation.h"
+#include "assettable.h"
 #include "geometry.h"
+#include "mappedfile.h"
+#include "parser.h"
+#include "threadpool.h"
 
 struct TextureConfig
 {
@@ -17,7 +29,7 @@ struct TextureConfig
 	std::string path;
 };
 
-inline std::istream& operator>>(std::istream& input, TextureConfig& config) {
+inline ParserLine& operator>>(ParserLine& input, TextureConfig& config) {
 	return input
 		>> config.name
 		>> config.path;
@@ -32,7 +44,7 @@ struct AnimationConfig
 	int delay;
 };
 
-inline std::istream& operator>>(std::istream& input, AnimationConfig& config) {
+inline ParserLine& operator>>(ParserLine& input, AnimationConfig& config) {
 	return input
 		>> config.name
 		>> config.texture
@@ -47,7 +59,7 @@ struct FontConfig
 	std::string path;
 };
 
-inline std::istream& operator>>(std::istream& input, FontConfig& config) {
+inline ParserLine& operator>>(ParserLine& input, FontConfig& config) {
 	return input
 		>> config.name
 		>> config.path;
@@ -60,7 +72,37 @@ struct LevelConfig
 	std::string path;
 };
 
-inline std::istream& operator>>(std::istream& input, LevelConfig& config) {
+inline ParserLine& operator>>(ParserLine& input, LevelConfig& config) {
+	return input
+		>> config.name
+		>> config.path;
+}
+
+struct SoundConfig
+{
+	// "Sound" <name> <path/sound.wav> <priority> <volume>
+	std::string name;
+	std::string path;
+	int priority; // higher priorities take voices from lower ones when all are busy
+	float volume; // 0 - 100
+};
+
+inline ParserLine& operator>>(ParserLine& input, SoundConfig& config) {
+	return input
+		>> config.name
+		>> config.path
+		>> config.priority
+		>> config.volume;
+}
+
+struct MusicConfig
+{
+	// "Music" <name> <path/track.ogg>
+	std::string name;
+	std::string path;
+};
+
+inline ParserLine& operator>>(ParserLine& input, MusicConfig& config) {
 	return input
 		>> config.name
 		>> config.path;
@@ -83,23 +125,184 @@ private:
 	const std::string assetName;
 };
 
+struct TextureAsset
+{
+	// Created with the asset when graphics are loaded, never without: an sf::Texture needs a GL context
+	std::unique_ptr<sf::Texture> texture;
+	vec2 size; // known before the texture is loaded, clips and collision boxes don't wait for residency
+	mutable std::atomic<bool> ready{ false }; // resident: decoded and uploaded
+};
+
+// Decoded samples, kept in memory so playing a sound never touches the disk
+struct SoundAsset
+{
+	sf::SoundBuffer buffer;
+	int priority = 0;
+	float volume = 100;
+};
+
+struct LoadProgress
+{
+	size_t loaded = 0;
+	size_t total = 0;
+
+	float fraction() const { return total > 0 ? (float)loaded / total : 1.0f; }
+};
+
+// A file below the resources directory was reloaded
+struct AssetChange
+{
+	enum class Type : uint8_t
+	{
+		Texture,
+		Font,
+		Level,
+		Sound,
+	};
+
+	Type type = Type::Texture;
+	uint32_t index = 0; // handle index within its table
+	vec2 size; // Texture only: size of the new image
+};
+
+typedef AssetHandle<TextureAsset> TextureHandle;
+typedef AssetHandle<sf::Font> FontHandle;
+typedef AssetHandle<AnimationClip> AnimationHandle;
+typedef AssetHandle<LevelConfig> LevelHandle;
+typedef AssetHandle<SoundAsset> SoundHandle;
+typedef AssetHandle<MusicConfig> MusicHandle;
+
 class Assets
 {
-	std::map<std::string, sf::Texture> textures;
-	std::map<std::string, sf::Sound> sounds;
-	std::map<std::string, sf::Font> fonts;
-	std::map<std::string, Animation> animations;
-	std::map<std::string, LevelConfig> levels;
+	bool loadGraphics;
+	// Backs the fonts loaded from a pack, so it has to outlive them
+	MappedFile pack;
+	AssetTable<TextureAsset> textures;
+	AssetTable<SoundAsset> sounds;
+	AssetTable<MusicConfig> music;
+	AssetTable<sf::Font> fonts;
+	AssetTable<AnimationClip> animations;
+	AssetTable<LevelConfig> levels;
+
+	// Residency of textures, indexed by texture handle and guarded by residencyMutex.
+	// Textures load when first retained and stay resident until the budget needs room,
+	// then the ones nobody references are evicted least recently released first.
+	// Tracking residency doesn't change the assets themselves, so it is allowed through const methods.
+	struct TextureResidency
+	{
+		std::string file; // empty for textures from a pack
+		const uint8_t* packedPixels = nullptr;
+		int references = 0;
+		bool loading = false;
+		bool resident = false;
+		bool unused = false; // resident, unreferenced and in unusedTextures
+		std::list<uint32_t>::iterator unusedEntry;
+		std::future<sf::Image> image;
+	};
+	mutable std::mutex residencyMutex;
+	mutable std::vector<TextureResidency> residency;
+	mutable std::vector<uint32_t> loadingTextures;
+	mutable std::list<uint32_t> unusedTextures; // most recently released first
+	mutable size_t queuedLoads = 0;
+	mutable size_t completedLoads = 0;
+	size_t residentBytes = 0;
+	size_t textureBudget = SIZE_MAX;
+	std::unique_ptr<ThreadPool> pool;
+	std::function<void(const LoadProgress&)> onProgress;
+
+	void registerTexture(TextureHandle handle, vec2 size, const std::string& file, const uint8_t* packedPixels);
+	void upload(TextureHandle handle, TextureResidency& state);
+	void evict();
+
+	// Assets loaded from files, by path relative to the resources directory, for reloading
+	std::string resourcesPath;
+	std::unordered_map<std::string, AssetChange> sources;
 
 public:
+	// Without graphics no GPU textures are created, only their sizes are read so animations can still be set up.
+	// Sound buffers aren't loaded either, headless runs have no audio.
+	explicit Assets(bool loadGraphics = true)
+		: loadGraphics(loadGraphics) {
+	}
+
+	// Reads the manifest, only image headers are read. Images are decoded on a worker pool once retained.
 	void loadResources(const std::string& path);
+	// Registers the contents of a pack written by bakeAssetPack(), textures are created straight from the mapped pixels
+	void loadPack(const std::string& path);
+	// Uploads finished textures and evicts unused ones while over budget, call every frame from the thread owning the textures
+	void update();
+	// Called from update() whenever textures were uploaded
+	void setProgressCallback(std::function<void(const LoadProgress&)> callback);
+	// Bytes of texture memory to keep resident, referenced textures are never evicted even when over budget
+	void setTextureBudget(size_t bytes);
+
+	// Reference counting of textures, safe to call from any thread.
+	// The first retain() starts loading, isReady() tells when it can be drawn.
+	void retain(TextureHandle handle) const;
+	void release(TextureHandle handle) const;
+
+	// Reloads the asset loaded from this file in place, path relative to the resources directory.
+	// Call from the thread owning the textures, then hand the change to applyChange() on the simulation thread.
+	// Returns false when the file isn't an asset or failed to load, the old data is kept in that case.
+	bool reloadFile(const std::string& path, AssetChange& change);
+	// Updates the data derived from a reloaded asset, like the frame sizes of its clips
+	void applyChange(const AssetChange& change);
+
+	// Safe to call from any thread. Loaded means nothing is waiting to be uploaded.
+	bool isLoaded() const;
+	LoadProgress getProgress() const;
+	bool isReady(TextureHandle handle) const;
+	bool isReady(AnimationHandle handle) const;
 
-	const sf::Texture& getTexture(const std::string& name) const;
-	const sf::Sound& getSound(const std::string& name) const;
-	const sf::Font& getFont(const std::string& name) const;
-	const Animation& getAnimation(const std::string& name) const;
-	const LevelConfig& getLevel(const std::string& name) const;
+	// Resolve names into handles, throws MissingAssetException for unknown names.
+	// Meant for load time, gameplay code should hold on to the handles.
+	TextureHandle findTexture(AssetName name) const;
+	FontHandle findFont(AssetName name) const;
+	AnimationHandle findAnimation(AssetName name) const;
+	LevelHandle findLevel(AssetName name) const;
+
+	// Constant time lookups by handle. Textures are only reached through their clips, headless runs have none.
+	vec2 getTextureSize(TextureHandle handle) const;
+	const sf::Font& getFont(FontHandle handle) const;
+	const AnimationClip& getAnimation(AnimationHandle handle) const;
+	const LevelConfig& getLevel(LevelHandle handle) const;
+
+	// Lookups by name, resolving the handle every time
+	const sf::Font& getFont(AssetName name) const { return getFont(findFont(name)); }
+	const AnimationClip& getAnimation(AssetName name) const { return getAnimation(findAnimation(name)); }
+	const LevelConfig& getLevel(AssetName name) const { return getLevel(findLevel(name)); }
+
+	// Audio is optional: unknown names give an invalid handle, and playing one does nothing
+	SoundHandle findSound(AssetName name) const;
+	MusicHandle findMusic(AssetName name) const;
+	const SoundAsset& getSound(SoundHandle handle) const;
+	const MusicConfig& getMusic(MusicHandle handle) const;
 
 	const std::vector<std::string> getLevelNames() const;
 
 };
+
+// The textures a scene needs, retained for as long as they are part of the set
+class AssetReferences
+{
+public:
+	explicit AssetReferences(const Assets& assets)
+		: assets(assets) {
+	}
+	~AssetReferences() {
+		clear();
+	}
+
+	AssetReferences(const AssetReferences&) = delete;
+	AssetReferences& operator=(const AssetReferences&) = delete;
+
+	// Retains the new textures before releasing the old ones, so shared textures stay resident
+	void set(std::vector<TextureHandle> handles);
+	void clear();
+	// All textures in the set are resident
+	bool ready() const;
+
+private:
+	const Assets& assets;
+	std::vector<TextureHandle> textures;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// FNV-1a. Constexpr, so a constexpr AssetName is hashed at compile time. A literal passed straight to a
+// lookup may still be hashed at run time (always in unoptimized builds), keep those out of per tick code.
+constexpr uint32_t hashAssetName(std::string_view name) {
+	uint32_t hash = 2166136261u;
+	for (char character : name) {
+		hash ^= (uint8_t)character;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Asset name together with its hash, the text is only used for error messages and debug checks
+struct AssetName
+{
+	uint32_t hash;
+	std::string_view text;
+
+	constexpr AssetName(std::string_view name)
+		: hash(hashAssetName(name))
+		, text(name) {
+	}
+	constexpr AssetName(const char* name)
+		: AssetName(std::string_view(name)) {
+	}
+	AssetName(const std::string& name)
+		: AssetName(std::string_view(name)) {
+	}
+};
+
+// Index of an asset inside its AssetTable, resolve once and then look up in O(1)
+template<typename T>
+struct AssetHandle
+{
+	static constexpr uint32_t invalidIndex = UINT32_MAX;
+	uint32_t index = invalidIndex;
+
+	bool valid() const { return index != invalidIndex; }
+	bool operator==(const AssetHandle& other) const { return index == other.index; }
+	bool operator!=(const AssetHandle& other) const { return index != other.index; }
+};
+
+// Dense storage of named assets. References stay valid when more assets are added.
+template<typename T>
+class AssetTable
+{
+public:
+	// Returns the handle of the asset with this name, adding a default constructed one if there is none yet
+	AssetHandle<T> insert(const std::string& name) {
+		AssetHandle<T> handle = find(name);
+		if (handle.valid()) {
+			return handle;
+		}
+		uint32_t hash = hashAssetName(name);
+		auto existing = lookup.find(hash);
+		if (existing != lookup.end()) {
+			throw std::runtime_error("Asset name '" + name + "' has the same hash as '" + names[existing->second] + "'");
+		}
+		handle.index = (uint32_t)items.size();
+		items.emplace_back();
+		names.push_back(name);
+		lookup.emplace(hash, handle.index);
+		return handle;
+	}
+
+	// Returns an invalid handle when there is no asset with this name
+	AssetHandle<T> find(AssetName name) const {
+		AssetHandle<T> handle;
+		auto it = lookup.find(name.hash);
+		if (it != lookup.end()) {
+			handle.index = it->second;
+			// Hashes are checked for collisions on insert, in debug builds also verify lookups
+			assert(names[handle.index] == name.text);
+		}
+		return handle;
+	}
+
+	T& operator[](AssetHandle<T> handle) {
+		assert(handle.index < items.size());
+		return items[handle.index];
+	}
+	const T& operator[](AssetHandle<T> handle) const {
+		assert(handle.index < items.size());
+		return items[handle.index];
+	}
+
+	const std::string& getName(AssetHandle<T> handle) const {
+		return names[handle.index];
+	}
+	size_t size() const {
+		return items.size();
+	}
+
+private:
+	std::deque<T> items;
+	std::deque<std::string> names;
+	std::unordered_map<uint32_t, uint32_t> lookup;
+};
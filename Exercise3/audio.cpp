@@ -0,0 +1,88 @@
+#include "audio.h"
+#include <iomanip>
+#include <iostream>
+
+AudioMixer::AudioMixer(const Assets& assets, size_t voiceCount)
+	: assets(assets)
+	, voices(voiceCount) {
+}
+
+void AudioMixer::apply(const SoundEvent& event) {
+	switch (event.type) {
+		case SoundEvent::Type::Sound:
+			play(SoundHandle{ event.index });
+			break;
+		case SoundEvent::Type::Music:
+			playMusic(MusicHandle{ event.index });
+			break;
+		case SoundEvent::Type::StopMusic:
+			stopMusic();
+			break;
+	}
+}
+
+void AudioMixer::play(SoundHandle handle) {
+	if (!handle.valid() || voices.empty()) {
+		return;
+	}
+	auto& asset = assets.getSound(handle);
+
+	// A free voice, otherwise the least important and oldest one
+	Voice* voice = nullptr;
+	for (auto& candidate : voices) {
+		if (candidate.sound.getStatus() == sf::SoundSource::Stopped) {
+			voice = &candidate;
+			break;
+		}
+		if (!voice || candidate.priority < voice->priority || (candidate.priority == voice->priority && candidate.started < voice->started)) {
+			voice = &candidate;
+		}
+	}
+	if (voice->sound.getStatus() != sf::SoundSource::Stopped && voice->priority > asset.priority) {
+		return;
+	}
+
+	voice->sound.stop();
+	if (voice->sound.getBuffer() != &asset.buffer) {
+		voice->sound.setBuffer(asset.buffer);
+	}
+	voice->sound.setVolume(asset.volume);
+	voice->priority = asset.priority;
+	voice->started = playCount++;
+	voice->sound.play();
+}
+
+void AudioMixer::playMusic(MusicHandle handle) {
+	if (!handle.valid() || voices.empty()) {
+		return;
+	}
+	if (music && handle == currentMusic && music->getStatus() == sf::SoundSource::Playing) {
+		return;
+	}
+	if (!music) {
+		music = std::make_unique<sf::Music>();
+	}
+	auto& config = assets.getMusic(handle);
+	if (!music->openFromFile(config.path)) {
+		std::cout << "Failed to open music " << std::quoted(config.name) << " from " << std::quoted(config.path) << std::endl;
+		currentMusic = MusicHandle();
+		return;
+	}
+	currentMusic = handle;
+	music->setLoop(true);
+	music->play();
+}
+
+void AudioMixer::stopMusic() {
+	if (music) {
+		music->stop();
+	}
+	currentMusic = MusicHandle();
+}
+
+void AudioMixer::stopAll() {
+	for (auto& voice : voices) {
+		voice.sound.stop();
+	}
+	stopMusic();
+}
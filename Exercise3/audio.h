@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <SFML/Audio.hpp>
+#include "assets.h"
+
+// Audio requested by the simulation thread, played by the thread owning the mixer
+struct SoundEvent
+{
+	enum class Type : uint8_t
+	{
+		Sound,
+		Music,
+		StopMusic,
+	};
+
+	Type type = Type::Sound;
+	uint32_t index = 0; // SoundHandle or MusicHandle index
+};
+
+// Plays sounds on a fixed set of voices created up front, so playing never creates audio sources.
+// When every voice is busy the one with the lowest priority is taken, the oldest of those first.
+// A sound is dropped when everything playing is more important.
+class AudioMixer
+{
+public:
+	// No voices means no audio at all, for running without an audio device
+	AudioMixer(const Assets& assets, size_t voiceCount);
+
+	AudioMixer(const AudioMixer&) = delete;
+	AudioMixer& operator=(const AudioMixer&) = delete;
+
+	void apply(const SoundEvent& event);
+	void play(SoundHandle handle);
+	// Streams the track from its file and loops it, playing the current track again does nothing
+	void playMusic(MusicHandle handle);
+	void stopMusic();
+	void stopAll();
+
+private:
+	struct Voice
+	{
+		sf::Sound sound;
+		int priority = 0;
+		uint64_t started = 0;
+	};
+
+	const Assets& assets;
+	std::vector<Voice> voices;
+	uint64_t playCount = 0;
+	std::unique_ptr<sf::Music> music; // created on first use
+	MusicHandle currentMusic;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 struct Command
 {
 	enum Type
@@ -10,11 +12,17 @@ struct Command
 		Down,
 		Fire,
 		Pause,
+		Restart,
+		SaveState,
+		LoadState,
+		Rewind, // held
 		DebugTextures,
 		DebugBoxes,
 		DebugGrid,
+		DebugPerf,
 	};
 
 	Type type;
 	bool ended = false;
+	uint8_t player = 0; // which player the command controls
 };
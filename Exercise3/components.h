@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <tuple>
 #include "animation.h"
 #include "geometry.h"
@@ -34,8 +35,8 @@ struct CInput : public Component
 struct CPlayerState : public Component
 {
 	bool canJump = false;
-	int jumpStart = 0;
-	int maxJumpLength = 1; // frames
+	float jumpStart = 0; // gameplay time, 0 when not jumping
+	float maxJumpLength = 1; // frames
 };
 
 struct CBoundingBox : public Component
@@ -45,10 +46,23 @@ struct CBoundingBox : public Component
 	CBoundingBox() = default;
 };
 
+// Draw order, lower layers are drawn first
+enum class RenderLayer : uint8_t
+{
+	Decoration,
+	World,
+	Items,
+	Actors,
+	Effects,
+};
+
 struct CAnimation : public Component
 {
+	// Only one-shot animations advance their own playback state,
+	// looping ones are stateless and derive their frame from the scene clock while rendering
 	Animation animation;
 	bool loop = false;
+	RenderLayer layer = RenderLayer::World;
 	CAnimation() = default;
 };
 
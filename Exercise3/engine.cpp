@@ -1,13 +1,72 @@
 #include "engine.h"
+#include "input.h"
+#include "profiler.h"
 #include "scenes/mainmenu.h"
 #include "scenes/playlevel.h"
 
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <memory>
 
-GameEngine::GameEngine() {
-	// Load assets
-	assets.loadResources("./resources");
+GameEngine::GameEngine(const EngineSettings& initialSettings)
+	: settings(initialSettings)
+	, assets(!settings.headless)
+	, audio(assets, settings.headless ? 0 : settings.soundVoices)
+	, viewSize(1980, 1080) {
+	if (!settings.profilePath.empty()) {
+		Profiler::setEnabled(true);
+		Profiler::setThreadName(settings.headless ? "Simulation" : "Render");
+	}
+	// A replay plays out the same only with the settings it was recorded with
+	if (!settings.replayPath.empty()) {
+		replay = std::make_unique<InputReplay>(settings.replayPath);
+		auto& header = replay->getHeader();
+		settings.startLevel = header.level;
+		settings.tickRate = header.tickRate;
+		settings.chunkSize = header.chunkSize;
+		settings.streamRadius = header.streamRadius;
+		settings.streamHysteresis = header.streamHysteresis;
+		settings.players = header.players;
+		std::cout << "Replaying " << replay->getTicks() << " ticks of level " << std::quoted(header.level) << std::endl;
+	}
+
+	// Register assets, textures are loaded in the background once a scene needs them
+	assets.setTextureBudget(settings.textureBudget);
+	assets.setProgressCallback([](const LoadProgress& progress) {
+		std::cout << "Loaded " << progress.loaded << "/" << progress.total << " textures" << std::endl;
+	});
+	if (settings.assetPack.empty()) {
+		assets.loadResources("./resources");
+	} else {
+		assets.loadPack(settings.assetPack);
+	}
+	if (settings.hotReload) {
+		if (settings.assetPack.empty() && !settings.headless) {
+			watcher = std::make_unique<FileWatcher>("./resources");
+		} else {
+			std::cout << "Hot reload needs a window and assets loaded from ./resources, ignored" << std::endl;
+		}
+	}
+	// Clips in a state recording are looked up by name, so it is opened once the assets are
+	if (!settings.seekPath.empty()) {
+		stateRecording = std::make_unique<StateRecording>(settings.seekPath, assets);
+		auto& header = stateRecording->getHeader();
+		if (replay && header.level != replay->getHeader().level) {
+			throw std::runtime_error("The state recording and the replay are of different levels");
+		}
+		settings.startLevel = header.level;
+		settings.tickRate = header.tickRate;
+		settings.chunkSize = header.chunkSize;
+		settings.streamRadius = header.streamRadius;
+		settings.streamHysteresis = header.streamHysteresis;
+		settings.players = header.players;
+		if (settings.seekTick < stateRecording->getFirstTick() || settings.seekTick > stateRecording->getLastTick()) {
+			throw std::runtime_error("Tick " + std::to_string(settings.seekTick) + " isn't in the state recording, it has ticks "
+				+ std::to_string(stateRecording->getFirstTick()) + " to " + std::to_string(stateRecording->getLastTick()));
+		}
+	}
 
 	// Key bindings
 	actions[sf::Keyboard::W] = Command::Up;
@@ -16,28 +75,393 @@ GameEngine::GameEngine() {
 	actions[sf::Keyboard::D] = Command::Right;
 	actions[sf::Keyboard::Space] = Command::Fire;
 	actions[sf::Keyboard::Escape] = Command::Pause;
+	actions[sf::Keyboard::R] = Command::Restart;
+	actions[sf::Keyboard::F5] = Command::SaveState;
+	actions[sf::Keyboard::F9] = Command::LoadState;
+	actions[sf::Keyboard::Backspace] = Command::Rewind;
 	actions[sf::Keyboard::Num1] = Command::DebugTextures;
 	actions[sf::Keyboard::Num2] = Command::DebugBoxes;
 	actions[sf::Keyboard::Num3] = Command::DebugGrid;
+	actions[sf::Keyboard::Num4] = Command::DebugPerf;
 
 	// Window
-	window.create(sf::VideoMode(1980, 1080), "Exercise 3", sf::Style::Close | sf::Style::Titlebar);
-	window.setFramerateLimit(60);
+	if (!settings.headless) {
+		window = std::make_unique<sf::RenderWindow>(sf::VideoMode(viewSize.x, viewSize.y), "Exercise 3", sf::Style::Close | sf::Style::Titlebar);
+		window->setVerticalSyncEnabled(true);
+	}
 
 	// Setup scenes
 	scenes["MainMenu"] = std::make_shared<Scene_MainMenu>(this);
 	scenes["PlayLevel"] = std::make_shared<Scene_PlayLevel>(this);
-	playMainMenu();
+	bool netplay = settings.netPlayer >= 0 || settings.fakeLatency >= 0 || settings.checksumCheck;
+	bool recording = !settings.recordPath.empty() || replay || !settings.stateRecordPath.empty() || stateRecording;
+	if (netplay || recording) {
+		if (settings.startLevel.empty()) {
+			throw std::runtime_error("Netplay, checksum checks and recordings need the level to play given with --level");
+		}
+		if (netplay && recording) {
+			throw std::runtime_error("Netplay sessions can't be recorded or replayed");
+		}
+		// Chunks have to load on the same tick on both peers, and in a replay on the same tick as when recorded
+		std::static_pointer_cast<Scene_PlayLevel>(scenes.at("PlayLevel"))->setDeterministic(true);
+	}
+	if (settings.startLevel.empty()) {
+		playMainMenu();
+	} else {
+		playLevel(settings.startLevel);
+	}
+	if (settings.netPlayer >= 0 && settings.fakeLatency < 0) {
+		transport = std::make_unique<UdpTransport>(settings.netPort, settings.netPeer);
+		auto& scene = static_cast<Scene_PlayLevel&>(*activeScene);
+		session = std::make_unique<RollbackSession>(this, scene, *transport, settings.netPlayer, settings.rollback);
+		std::cout << "Playing as player " << settings.netPlayer << " on port " << settings.netPort << " with " << settings.netPeer << std::endl;
+	}
+	ReplayHeader header;
+	header.level = settings.startLevel;
+	header.tickRate = settings.tickRate;
+	header.chunkSize = settings.chunkSize;
+	header.streamRadius = settings.streamRadius;
+	header.streamHysteresis = settings.streamHysteresis;
+	header.players = settings.players;
+	if (!settings.recordPath.empty()) {
+		recorder = std::make_unique<InputRecorder>(settings.recordPath, header);
+		std::cout << "Recording to " << std::quoted(settings.recordPath) << std::endl;
+	}
+	if (!settings.stateRecordPath.empty()) {
+		stateRecorder = std::make_unique<StateRecorder>(settings.stateRecordPath, header, settings.keyframeInterval);
+		std::cout << "Recording level states to " << std::quoted(settings.stateRecordPath) << std::endl;
+	}
 }
 
 void GameEngine::run() {
-	while (activeScene) {
-		// Parse inputs
+	if (settings.headless) {
+		return runHeadless();
+	}
+
+	running = true;
+	simulation = std::thread(&GameEngine::simulate, this);
+
+	while (running) {
+		ProfileZone zone("Frame", ProfileZone::Frame);
+		// Textures must be created and destroyed on the thread owning the window
+		assets.update();
+		if (watcher) {
+			reloadAssets();
+		}
+		playSounds();
+
+		// Parse inputs, hands them over to the simulation thread
 		processInput();
 
-		// Run game tick
+		// Draw the latest state published by the simulation thread
+		renderFrame();
+	}
+
+	simulation.join();
+	printSessionStats();
+	activeScene->leave();
+	audio.stopAll();
+	window->close();
+}
+
+void GameEngine::simulate() {
+	if (Profiler::enabled()) {
+		Profiler::setThreadName("Simulation");
+	}
+	using clock = std::chrono::steady_clock;
+	const auto tickDuration = getTickDuration();
+	auto previousTime = clock::now();
+	clock::duration accumulator = clock::duration::zero();
+
+	while (running) {
+		auto now = clock::now();
+		accumulator += now - previousTime;
+		previousTime = now;
+
+		applyAssetChanges();
+
+		// Run as many fixed ticks as fit in the elapsed time
+		int ticks = 0;
+		while (accumulator >= tickDuration && ticks < settings.maxCatchUpTicks) {
+			// Apply inputs received since the last tick
+			Command command;
+			while (commands.pop(command)) {
+				if (session) {
+					session->perform(command);
+				} else {
+					performCommand(command);
+				}
+			}
+
+			// Run game tick, a session waiting for the peer lets the tick pass
+			if (session) {
+				session->advance();
+			} else {
+				simulateTick();
+			}
+			accumulator -= tickDuration;
+			ticks++;
+		}
+		if (replay && replay->finished()) {
+			running = false;
+		}
+		if (accumulator >= tickDuration) {
+			// Too far behind, drop the backlog rather than spiralling
+			accumulator = accumulator % tickDuration;
+		}
+
+		if (ticks > 0) {
+			// Publish the resulting state for the render thread
+			auto& snapshot = snapshots.write();
+			snapshot.clear();
+			snapshot.tickTime = clock::now() - accumulator;
+			activeScene->render(snapshot);
+			snapshots.publish();
+		}
+
+		// Sleep until the next tick is due
+		std::this_thread::sleep_until(previousTime + (tickDuration - accumulator));
+	}
+}
+
+void GameEngine::applyAssetChanges() {
+	AssetChange change;
+	while (assetChanges.pop(change)) {
+		assets.applyChange(change);
+		activeScene->assetChanged(change);
+	}
+}
+
+void GameEngine::runHeadless() {
+	if (settings.inputScript.empty() && !replay && settings.maxTicks <= 0) {
+		throw std::runtime_error("Headless runs need an input script, a replay or a tick limit to end");
+	}
+	if (settings.fakeLatency >= 0) {
+		return runFakeNetwork();
+	}
+	if (settings.checksumCheck) {
+		return runChecksumCheck();
+	}
+
+	ScriptedInput script;
+	if (!settings.inputScript.empty()) {
+		script = ScriptedInput(settings.inputScript);
+	}
+
+	// Null render backend: scenes still describe every frame, but the snapshot is never drawn
+	RenderSnapshot snapshot;
+	auto nextTick = std::chrono::steady_clock::now();
+	for (int tick = 0; !headlessFinished(script, tick); tick++) {
+		Command command;
+		while (script.poll(tick, command)) {
+			performCommand(command);
+		}
+
+		simulateTick();
+
+		snapshot.clear();
+		activeScene->render(snapshot);
+
+		if (!settings.unthrottled) {
+			nextTick += getTickDuration();
+			std::this_thread::sleep_until(nextTick);
+		}
+	}
+
+	printSessionStats();
+	activeScene->leave();
+}
+
+bool GameEngine::headlessFinished(const ScriptedInput& script, int tick) const {
+	if (settings.maxTicks > 0 && tick >= settings.maxTicks) {
+		return true;
+	}
+	if (replay) {
+		return replay->finished();
+	}
+	// Without a script only the tick limit ends the run
+	return !settings.inputScript.empty() && script.finished(tick);
+}
+
+void GameEngine::performCommand(const Command& command) {
+	if (replay) {
+		// The recording is the input, only what is drawn can still be changed
+		if (command.type == Command::DebugTextures || command.type == Command::DebugBoxes || command.type == Command::DebugGrid
+			|| command.type == Command::DebugPerf) {
+			activeScene->perform(command);
+		}
+		return;
+	}
+	if (recorder) {
+		recorder->perform(command);
+	}
+	activeScene->perform(command);
+}
+
+void GameEngine::simulateTick() {
+	if (!recorder && !replay && !stateRecorder && !stateRecording) {
 		activeScene->tick();
+		return;
+	}
+	// Recordings start once the level can be played, so loading times don't shift them
+	if (!activeScene->ready()) {
+		return;
+	}
+	if (stateRecording) {
+		auto start = std::chrono::steady_clock::now();
+		auto scene = std::static_pointer_cast<Scene_PlayLevel>(activeScene);
+		scene->loadState(stateRecording->seek(settings.seekTick));
+		sessionTicks = settings.seekTick;
+		if (replay) {
+			replay->skipTo(sessionTicks);
+		}
+		stateRecording.reset();
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		std::cout << "Seeked to tick " << sessionTicks << " in " << elapsed.count() << "us" << std::endl;
+	}
+	if (replay) {
+		Command command;
+		while (replay->poll(command)) {
+			activeScene->perform(command);
+		}
+	}
+	auto start = std::chrono::steady_clock::now();
+	activeScene->tick();
+	tickTimes.add(std::chrono::steady_clock::now() - start);
+
+	uint64_t checksum = activeScene->checksum();
+	if (recorder) {
+		recorder->endTick(checksum);
+	}
+	if (replay) {
+		replay->endTick(checksum);
+	}
+	sessionTicks++;
+	if (stateRecorder) {
+		std::static_pointer_cast<Scene_PlayLevel>(activeScene)->saveState(levelState);
+		stateRecorder->record(sessionTicks, levelState);
+	}
+}
+
+void GameEngine::printSessionStats() {
+	if (session) {
+		std::cout << "Rollback session: " << session->getStats() << std::endl;
+	}
+	if (recorder) {
+		std::cout << "Recorded " << recorder->getTicks() << " ticks to " << std::quoted(settings.recordPath) << std::endl;
+		recorder.reset();
+	}
+	if (stateRecorder) {
+		std::cout << "Recorded the level states of " << sessionTicks << " ticks to " << std::quoted(settings.stateRecordPath);
+		std::cout << ", " << stateRecorder->getBytesWritten() / 1024 << " KiB" << std::endl;
+		stateRecorder.reset();
+	}
+	if (replay) {
+		if (replay->getDivergedTick() < 0) {
+			std::cout << "Replayed " << replay->getTick() << " of " << replay->getTicks() << " ticks in sync with the recording" << std::endl;
+		} else {
+			std::cout << "Replay diverged at tick " << replay->getDivergedTick() << " of " << replay->getTicks() << std::endl;
+		}
+	}
+	if (!tickTimes.empty()) {
+		std::cout << "Tick times: ";
+		tickTimes.print(std::cout);
+		std::cout << std::endl;
+	}
+	if (Profiler::enabled()) {
+		auto threads = Profiler::collect();
+		std::cout << "Profile, per frame for zones inside frames:" << std::endl;
+		Profiler::printStats(std::cout, Profiler::stats(threads));
+		Profiler::writeChromeTrace(settings.profilePath, threads);
+		std::cout << "Wrote the trace to " << std::quoted(settings.profilePath) << std::endl;
+	}
+}
+
+void GameEngine::runFakeNetwork() {
+	ScriptedInput script;
+	if (!settings.inputScript.empty()) {
+		script = ScriptedInput(settings.inputScript);
+	}
+
+	// The second peer plays its own copy of the level
+	auto first = std::static_pointer_cast<Scene_PlayLevel>(activeScene);
+	auto second = std::make_shared<Scene_PlayLevel>(this);
+	second->setDeterministic(true);
+	second->setLevel(assets.getLevel(settings.startLevel));
+	second->enter();
+
+	FakeNetwork network(settings.fakeLatency, settings.fakeJitter, settings.fakeLoss);
+	RollbackSession sessions[2] = {
+		RollbackSession(this, *first, network.endpoint(0), 0, settings.rollback),
+		RollbackSession(this, *second, network.endpoint(1), 1, settings.rollback),
+	};
+
+	RenderSnapshot snapshot;
+	auto nextTick = std::chrono::steady_clock::now();
+	for (int tick = 0; !headlessFinished(script, tick); tick++) {
+		Command command;
+		while (script.poll(tick, command)) {
+			if (command.player < 2) {
+				sessions[command.player].perform(command);
+			}
+		}
+
+		sessions[0].advance();
+		sessions[1].advance();
+		network.tick();
+
+		snapshot.clear();
+		first->render(snapshot);
+
+		if (!settings.unthrottled) {
+			nextTick += getTickDuration();
+			std::this_thread::sleep_until(nextTick);
+		}
+	}
+
+	for (int i = 0; i < 2; i++) {
+		std::cout << "Player " << i << " at frame " << sessions[i].getFrame() << ", confirmed " << sessions[i].getConfirmedFrame() << ": " << sessions[i].getStats() << std::endl;
+	}
+	printSessionStats();
+	second->leave();
+	activeScene->leave();
+}
+
+void GameEngine::runChecksumCheck() {
+	ScriptedInput script;
+	if (!settings.inputScript.empty()) {
+		script = ScriptedInput(settings.inputScript);
+	}
+
+	// The second scene shares nothing with the first but the assets, so only equal states give equal checksums
+	auto first = std::static_pointer_cast<Scene_PlayLevel>(activeScene);
+	auto second = std::make_shared<Scene_PlayLevel>(this);
+	second->setDeterministic(true);
+	second->setLevel(assets.getLevel(settings.startLevel));
+	second->enter();
+
+	int checked = 0;
+	for (int tick = 0; !headlessFinished(script, tick); tick++) {
+		Command command;
+		while (script.poll(tick, command)) {
+			first->perform(command);
+			second->perform(command);
+		}
+		// Like rollback peers, both start once the level can be played
+		if (!first->ready() || !second->ready()) {
+			continue;
+		}
+		first->tick();
+		second->tick();
+		if (first->checksum() != second->checksum()) {
+			throw std::runtime_error("Checksums of the two scenes differ after tick " + std::to_string(tick));
+		}
+		checked++;
 	}
+
+	std::cout << "Checksums of the two scenes agreed for " << checked << " ticks" << std::endl;
+	second->leave();
+	activeScene->leave();
 }
 
 void GameEngine::playLevel(const std::string& name) {
@@ -58,29 +482,103 @@ void GameEngine::playMainMenu() {
 	activeScene->enter();
 }
 
+void GameEngine::playSound(SoundHandle handle) {
+	if (handle.valid()) {
+		queueSound(SoundEvent{ SoundEvent::Type::Sound, handle.index });
+	}
+}
+
+void GameEngine::playMusic(MusicHandle handle) {
+	if (handle.valid()) {
+		queueSound(SoundEvent{ SoundEvent::Type::Music, handle.index });
+	}
+}
+
+void GameEngine::stopMusic() {
+	queueSound(SoundEvent{ SoundEvent::Type::StopMusic, 0 });
+}
+
+void GameEngine::setSoundsMuted(bool muted) {
+	soundsMuted = muted;
+}
+
+void GameEngine::queueSound(const SoundEvent& event) {
+	// Nobody drains the queue when headless. A full queue drops the sound, like a busy voice would.
+	if (!settings.headless && !soundsMuted) {
+		soundEvents.push(event);
+	}
+}
+
 const Assets& GameEngine::getAssets() {
 	return assets;
 }
 
-sf::RenderWindow& GameEngine::getWindow() {
-	return window;
+const EngineSettings& GameEngine::getSettings() const {
+	return settings;
+}
+
+vec2 GameEngine::getViewSize() const {
+	return viewSize;
+}
+
+float GameEngine::getTimeScale() const {
+	return referenceTickRate / settings.tickRate;
+}
+
+std::chrono::steady_clock::duration GameEngine::getTickDuration() const {
+	return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / settings.tickRate));
 }
 
 void GameEngine::processInput() {
 	sf::Event event;
-	while (window.pollEvent(event)) {
+	while (window->pollEvent(event)) {
 		if (event.type == sf::Event::Closed) {
-			window.close();
-			activeScene->leave();
-			return std::exit(0);
+			running = false;
+			return;
 		} else if (event.type == sf::Event::KeyPressed || event.type == sf::Event::KeyReleased) {
 			Command command;
 			auto pair = actions.find(event.key.code);
 			if (pair != actions.end()) {
 				command.type = pair->second;
 				command.ended = event.type == sf::Event::KeyReleased;
-				activeScene->perform(command);
+				if (!commands.push(command)) {
+					std::cout << "Input queue full, dropped command" << std::endl;
+				}
 			}
 		}
 	}
 }
+
+void GameEngine::reloadAssets() {
+	for (auto& path : watcher->poll()) {
+		// Textures and fonts are replaced here, everything derived from them is updated on the simulation thread
+		AssetChange change;
+		if (assets.reloadFile(path, change) && !assetChanges.push(change)) {
+			std::cout << "Asset change queue full, dropped reload of " << std::quoted(path) << std::endl;
+		}
+	}
+}
+
+void GameEngine::playSounds() {
+	SoundEvent event;
+	while (soundEvents.pop(event)) {
+		audio.apply(event);
+	}
+}
+
+void GameEngine::renderFrame() {
+	snapshots.fetch();
+	auto& snapshot = snapshots.read();
+
+	// Blend between the last two simulation states based on how far we are into the next tick
+	std::chrono::duration<float> sinceTick = std::chrono::steady_clock::now() - snapshot.tickTime;
+	std::chrono::duration<float> tickDuration = getTickDuration();
+	float alpha = std::clamp(sinceTick / tickDuration, 0.0f, 1.0f);
+
+	{
+		ProfileZone zone("Renderer::draw");
+		renderer.draw(*window, snapshot, alpha);
+	}
+	ProfileZone zone("window.display");
+	window->display();
+}
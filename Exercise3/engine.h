@@ -1,31 +1,168 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <unordered_map>
 #include <SFML/Window.hpp>
 
+#include "audio.h"
 #include "commands.h"
+#include "filewatcher.h"
+#include "input.h"
 #include "scene.h"
 #include "assets.h"
+#include "renderer.h"
+#include "replay.h"
+#include "rollback.h"
+#include "spscqueue.h"
+#include "staterecording.h"
+#include "triplebuffer.h"
+
+// Gameplay values (speeds, delays, durations) are expressed in frames at this rate
+constexpr float referenceTickRate = 60.0f;
+
+struct EngineSettings
+{
+	// Simulation ticks per second
+	float tickRate = referenceTickRate;
+	// Maximum number of ticks run back-to-back to catch up after a slow frame, the rest of the backlog is dropped
+	int maxCatchUpTicks = 5;
+	// Run without a window, nothing is drawn and input comes from inputScript
+	bool headless = false;
+	std::string inputScript;
+	// Headless only: run ticks back-to-back instead of pacing them at tickRate
+	bool unthrottled = false;
+	// Headless only: stop after this many ticks, 0 runs until the script or replay ends
+	int maxTicks = 0;
+	// Level to start in instead of the main menu
+	std::string startLevel;
+	// Baked asset pack to load instead of parsing resources/assets.txt
+	std::string assetPack;
+	// Level streaming: chunk edge length in cells, chunks loaded around the camera,
+	// and how many chunks further they have to be before unloading
+	int chunkSize = 16;
+	int streamRadius = 1;
+	int streamHysteresis = 1;
+	// Texture memory kept resident, textures no scene uses are evicted beyond this
+	size_t textureBudget = 256 * 1024 * 1024;
+	// Watch the resources directory and reload changed files, not available with an asset pack
+	bool hotReload = false;
+	// Sounds playing at the same time, further sounds take the voice of a less important one
+	size_t soundVoices = 16;
+	// Players spawned in a level, the ones the level doesn't place start next to its first player
+	int players = 1;
+	// Rollback netplay: the local player (-1 plays alone), the UDP port to bind and the peer as host:port
+	int netPlayer = -1;
+	unsigned short netPort = 7000;
+	std::string netPeer;
+	RollbackSettings rollback;
+	// Headless only: play both sides of a rollback session in-process over a simulated network.
+	// Latency and jitter in ticks, loss from 0 to 1. Script commands go to the player they name.
+	int fakeLatency = -1;
+	int fakeJitter = 0;
+	float fakeLoss = 0;
+	// Headless only: play the level in two scenes built independently with the same input, and fail
+	// as soon as their checksums differ
+	bool checksumCheck = false;
+	// Record the session's input to this file, or play back a recording instead of taking input.
+	// Replays use the level and simulation settings of the recording.
+	std::string recordPath;
+	std::string replayPath;
+	// Record the level state after every tick to this file, with a keyframe every keyframeInterval ticks,
+	// or start the session from the state a state recording has at seekTick. Seeking uses the level and
+	// simulation settings of the state recording, with a replay of the same session it continues the replay.
+	std::string stateRecordPath;
+	int keyframeInterval = 600;
+	std::string seekPath;
+	int seekTick = 0;
+	// Time the systems, asset loading and drawing, write the zones to this file as a Chrome trace when the
+	// session ends and print per frame statistics. Off when empty.
+	std::string profilePath;
+	// Seconds of play kept as one snapshot per tick, rewinding steps back through them. 0 keeps no history.
+	float rewindSeconds = 0;
+};
 
 class GameEngine
 {
 public:
-	GameEngine();
+	GameEngine(const EngineSettings& settings = EngineSettings());
 
 	void run();
 
 	void playLevel(const std::string& name);
 	void playMainMenu();
 
+	// Called from the simulation thread, the sounds are played on the render thread. Does nothing when headless.
+	void playSound(SoundHandle handle);
+	void playMusic(MusicHandle handle);
+	void stopMusic();
+	// Drops sounds queued until unmuted, while frames that already played are simulated again
+	void setSoundsMuted(bool muted);
+
 	const Assets& getAssets();
-	sf::RenderWindow& getWindow();
+	const EngineSettings& getSettings() const;
+	vec2 getViewSize() const;
+	// Number of reference frames that pass during a single simulation tick
+	float getTimeScale() const;
 
 private:
+	EngineSettings settings;
 	Assets assets;
+	AudioMixer audio;
 	std::map<std::string, std::shared_ptr<Scene>> scenes;
 	std::unordered_map<sf::Keyboard::Key, Command::Type> actions;
 	std::shared_ptr<Scene> activeScene;
-	sf::RenderWindow window;
+	// Null when headless, a window needs a display and a GL context
+	std::unique_ptr<sf::RenderWindow> window;
+	vec2 viewSize;
+	Renderer renderer;
+
+	std::chrono::steady_clock::duration getTickDuration() const;
 
+	// Shared between the render/input thread and the simulation thread
+	std::atomic<bool> running = false;
+	SpscQueue<Command, 256> commands;
+	SpscQueue<AssetChange, 64> assetChanges;
+	SpscQueue<SoundEvent, 64> soundEvents;
+	TripleBuffer<RenderSnapshot> snapshots;
+	std::thread simulation;
+
+	// Rollback netplay, owned by the simulation thread
+	std::unique_ptr<Transport> transport;
+	std::unique_ptr<RollbackSession> session;
+
+	// Input recording and playback, owned by the simulation thread
+	std::unique_ptr<InputRecorder> recorder;
+	std::unique_ptr<InputReplay> replay;
+	TickTimes tickTimes;
+	// Level state recording and seeking, the recording to seek in is dropped once the seek is done
+	std::unique_ptr<StateRecorder> stateRecorder;
+	std::unique_ptr<StateRecording> stateRecording;
+	LevelState levelState;
+	int sessionTicks = 0;
+
+	// Render/input thread
+	std::unique_ptr<FileWatcher> watcher;
 	void processInput();
+	void reloadAssets();
+	void playSounds();
+	void renderFrame();
+
+	// Simulation thread
+	void simulate();
+	void applyAssetChanges();
+	void queueSound(const SoundEvent& event);
+	void performCommand(const Command& command);
+	void simulateTick();
+	void printSessionStats();
+	bool soundsMuted = false;
+
+	// Headless mode runs the simulation directly on the calling thread
+	void runHeadless();
+	bool headlessFinished(const ScriptedInput& script, int tick) const;
+	// Both peers of a rollback session over a FakeNetwork
+	void runFakeNetwork();
+	// Two scenes side by side, throws when their checksums differ
+	void runChecksumCheck();
 };
@@ -1,4 +1,7 @@
 #include "entities.h"
+#include "profiler.h"
+#include <algorithm>
+#include <type_traits>
 
 const EntityPtr& Entities::get(EntityID id) {
 	for (auto& entity : m_alive) {
@@ -44,13 +47,18 @@ bool isEntityDead(EntityPtr entity) {
 }
 
 void Entities::update() {
+	ProfileZone zone("Entities::update");
 	// Remove dead entities
 	const auto reaper = [](EntityList& list) {
 		auto removed = std::remove_if(list.begin(), list.end(), isEntityDead);
 		list.erase(removed, list.end());
 	};
 
+	size_t aliveBefore = m_alive.size();
 	reaper(m_alive);
+	if (m_alive.size() != aliveBefore || !m_babies.empty()) {
+		m_generation++;
+	}
 	reaper(m_babies);
 	for (auto& pair : m_tagTable) {
 		reaper(pair.second);
@@ -60,14 +68,139 @@ void Entities::update() {
 	for (auto& baby : m_babies) {
 		if (!baby->dead()) {
 			m_alive.push_back(baby);
-			for (auto& tag : baby->m_tags) {
-				m_tagTable[tag].push_back(baby);
-			}
+			addToTagTable(baby);
 		}
 	}
 	m_babies.clear();
 }
 
+void Entities::addToTagTable(const EntityPtr& entity) {
+	for (uint32_t tags = entity->m_tags; tags != 0; tags &= tags - 1) {
+		uint32_t tag = 0;
+		while (!(tags & (1u << tag))) {
+			tag++;
+		}
+		m_tagTable[(Entity::Tag)tag].push_back(entity);
+	}
+}
+
+// Ids are handed out in increasing order and lists keep creation order, so they are sorted by id
+static EntityPtr findInList(const EntityList& list, EntityID id) {
+	auto it = std::lower_bound(list.begin(), list.end(), id, [](const EntityPtr& entity, EntityID id) {
+		return entity->id() < id;
+	});
+	return it != list.end() && (*it)->id() == id ? *it : nullptr;
+}
+
+EntityPtr Entities::find(EntityID id) const {
+	auto entity = findInList(m_alive, id);
+	return entity ? entity : findInList(m_babies, id);
+}
+
+template<typename... Components>
+static void saveComponents(SnapshotWriter& writer, const std::tuple<Components...>& components) {
+	static_assert((std::is_trivially_copyable_v<Components> && ...), "Components have to be trivially copyable to be snapshotted");
+	(writer.write(std::get<Components>(components)), ...);
+}
+
+template<typename... Components>
+static void restoreComponents(SnapshotReader& reader, std::tuple<Components...>& components) {
+	(reader.read(std::get<Components>(components)), ...);
+}
+
+void Entities::save(SnapshotWriter& writer) const {
+	// The generation isn't saved, snapshots of the same state compare equal however they were reached
+	writer.write((uint64_t)m_counter);
+	writer.write((uint32_t)m_alive.size());
+	writer.write((uint32_t)m_babies.size());
+	for (auto list : { &m_alive, &m_babies }) {
+		for (auto& entity : *list) {
+			writer.write((uint64_t)entity->m_id);
+			writer.write((uint8_t)entity->m_dead);
+			writer.write(entity->m_tags);
+			saveComponents(writer, entity->m_data);
+		}
+	}
+}
+
+void Entities::restore(SnapshotReader& reader) {
+	m_counter = (size_t)reader.read<uint64_t>();
+	uint32_t aliveCount = reader.read<uint32_t>();
+	uint32_t babyCount = reader.read<uint32_t>();
+
+	EntityList previous = beginRestore(aliveCount, babyCount);
+	for (uint32_t i = 0; i < aliveCount + babyCount; i++) {
+		auto& entity = restoreEntity(previous, (EntityID)reader.read<uint64_t>(), i >= aliveCount);
+		entity->m_dead = reader.read<uint8_t>() != 0;
+		reader.read(entity->m_tags);
+		restoreComponents(reader, entity->m_data);
+	}
+	endRestore();
+}
+
+void Entities::save(EntitiesState& state) const {
+	state.counter = m_counter;
+	state.entities.clear();
+	state.entities.reserve(m_alive.size() + m_babies.size());
+	for (auto list : { &m_alive, &m_babies }) {
+		for (auto& entity : *list) {
+			state.entities.push_back(EntityState{ entity->m_id, entity->m_dead, list == &m_babies, entity->m_tags, entity->m_data });
+		}
+	}
+}
+
+void Entities::restore(const EntitiesState& state) {
+	m_counter = state.counter;
+	uint32_t babyCount = (uint32_t)std::count_if(state.entities.begin(), state.entities.end(), [](const EntityState& entity) {
+		return entity.baby;
+	});
+
+	EntityList previous = beginRestore((uint32_t)state.entities.size() - babyCount, babyCount);
+	for (auto& saved : state.entities) {
+		auto& entity = restoreEntity(previous, saved.id, saved.baby);
+		entity->m_dead = saved.dead;
+		entity->m_tags = saved.tags;
+		entity->m_data = saved.components;
+	}
+	endRestore();
+}
+
+EntityList Entities::beginRestore(uint32_t aliveCount, uint32_t babyCount) {
+	// Babies were created after every alive entity, so together they stay sorted by id
+	EntityList previous = std::move(m_alive);
+	previous.insert(previous.end(), m_babies.begin(), m_babies.end());
+	for (auto& entity : previous) {
+		entity->m_dead = true;
+	}
+
+	m_alive.clear();
+	m_babies.clear();
+	m_alive.reserve(aliveCount);
+	m_babies.reserve(babyCount);
+	return previous;
+}
+
+const EntityPtr& Entities::restoreEntity(const EntityList& previous, EntityID id, bool baby) {
+	auto entity = findInList(previous, id);
+	if (!entity) {
+		entity = EntityPtr(new Entity(id, {}));
+	}
+	auto& list = baby ? m_babies : m_alive;
+	list.push_back(std::move(entity));
+	return list.back();
+}
+
+void Entities::endRestore() {
+	for (auto& pair : m_tagTable) {
+		pair.second.clear();
+	}
+	for (auto& entity : m_alive) {
+		addToTagTable(entity);
+	}
+	// Anything caching the entity lists has to rebuild
+	m_generation++;
+}
+
 const EntityPtr Entities::create(std::initializer_list<Entity::Tag> tags) {
 
 	EntityPtr entity(new Entity(m_counter++, tags));
@@ -75,6 +208,13 @@ const EntityPtr Entities::create(std::initializer_list<Entity::Tag> tags) {
 	return entity;
 }
 
+const EntityPtr Entities::create(std::initializer_list<Entity::Tag> tags, const ComponentTuple& components) {
+	EntityPtr entity(new Entity(m_counter++, tags));
+	entity->m_data = components;
+	m_babies.push_back(entity);
+	return entity;
+}
+
 void Entities::remove(const EntityPtr& entity) {
 	if (entity) {
 		entity->m_dead = true;
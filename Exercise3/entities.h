@@ -4,8 +4,8 @@
 #include <vector>
 #include <tuple>
 #include <initializer_list>
-#include <unordered_set>
 #include "components.h"
+#include "snapshot.h"
 
 typedef size_t EntityID;
 
@@ -29,7 +29,7 @@ struct Entity
 		return !dead();
 	}
 	bool hasTag(Tag tag) {
-		return m_tags.find(tag) != m_tags.end();
+		return (m_tags & tagBit(tag)) != 0;
 	}
 
 	template<typename T>
@@ -58,12 +58,18 @@ struct Entity
 private:
 	EntityID m_id;
 	bool m_dead = false;
-	std::unordered_set<Tag> m_tags;
+	uint32_t m_tags = 0; // one bit per tag
 	ComponentTuple m_data;
 
+	static uint32_t tagBit(Tag tag) {
+		return 1u << (uint32_t)tag;
+	}
+
 	Entity(EntityID id, std::initializer_list<Tag> tags)
-		: m_id(id)
-		, m_tags(tags) {
+		: m_id(id) {
+		for (auto tag : tags) {
+			m_tags |= tagBit(tag);
+		}
 	}
 
 	friend class Entities;
@@ -72,6 +78,22 @@ private:
 typedef std::shared_ptr<Entity> EntityPtr;
 typedef std::vector<EntityPtr> EntityList;
 
+// Copy of an entity, to put it back later
+struct EntityState
+{
+	EntityID id = 0;
+	bool dead = false;
+	bool baby = false; // created since the last update
+	uint32_t tags = 0; // one bit per Entity::Tag
+	ComponentTuple components;
+};
+
+struct EntitiesState
+{
+	size_t counter = 1;
+	std::vector<EntityState> entities; // sorted by id
+};
+
 class Entities
 {
 public:
@@ -81,14 +103,37 @@ public:
 	const EntityList list(std::initializer_list<Entity::Tag> tags);
 
 	const EntityPtr create(std::initializer_list<Entity::Tag> tags);
+	// Creates an entity with a copy of the given components, for spawning from prototypes
+	const EntityPtr create(std::initializer_list<Entity::Tag> tags, const ComponentTuple& components);
 	void remove(const EntityPtr& entity);
 	void remove(EntityID id);
 	void clear();
 
+	// Entity with this id, including ones created since the last update, null when there is none
+	EntityPtr find(EntityID id) const;
+
 	void update();
+	// Changes whenever update() added or removed entities
+	uint64_t generation() const { return m_generation; }
+
+	// Copies every entity with all its components into the snapshot
+	void save(SnapshotWriter& writer) const;
+	// Puts back the entities of a snapshot. Entities that exist in both keep their object, so pointers to them
+	// stay valid, entities that don't exist in the snapshot are marked dead.
+	void restore(SnapshotReader& reader);
+	// Same as above with the entities as structures, for encoding them in other ways
+	void save(EntitiesState& state) const;
+	void restore(const EntitiesState& state);
 
 private:
+	void addToTagTable(const EntityPtr& entity);
+	// Restoring marks every entity dead and keeps them aside, restored entities reuse the one with their id
+	EntityList beginRestore(uint32_t aliveCount, uint32_t babyCount);
+	const EntityPtr& restoreEntity(const EntityList& previous, EntityID id, bool baby);
+	void endRestore();
+
 	size_t m_counter = 1;
+	uint64_t m_generation = 0;
 	EntityList m_alive;
 	EntityList m_babies;
 	std::map<Entity::Tag, EntityList> m_tagTable;
@@ -0,0 +1,115 @@
+#include "filewatcher.h"
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+constexpr auto scanInterval = std::chrono::milliseconds(500);
+
+FileWatcher::FileWatcher(const std::string& directory)
+	: root(fs::absolute(directory)) {
+#ifdef __linux__
+	inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify >= 0) {
+		addWatch(root);
+		for (auto& entry : fs::recursive_directory_iterator(root)) {
+			if (entry.is_directory()) {
+				addWatch(entry.path());
+			}
+		}
+		std::cout << "Watching " << root << " for changes (inotify)" << std::endl;
+		return;
+	}
+#endif
+	// Remember the current state so only later changes are reported
+	scan(nullptr);
+	nextScan = std::chrono::steady_clock::now() + scanInterval;
+	std::cout << "Watching " << root << " for changes (polling)" << std::endl;
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+	if (inotify >= 0) {
+		close(inotify);
+	}
+#endif
+}
+
+std::vector<std::string> FileWatcher::poll() {
+	std::vector<std::string> changed;
+#ifdef __linux__
+	if (inotify >= 0) {
+		alignas(inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(inotify, buffer, sizeof(buffer))) > 0) {
+			for (char* position = buffer; position < buffer + length; ) {
+				auto event = (const inotify_event*)position;
+				position += sizeof(inotify_event) + event->len;
+
+				auto watch = watches.find(event->wd);
+				if (watch == watches.end() || event->len == 0) {
+					continue;
+				}
+				fs::path path = watch->second / event->name;
+				if (event->mask & IN_ISDIR) {
+					// New directories need their own watch
+					if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+						addWatch(path);
+					}
+				} else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+					changed.push_back(relative(path));
+				}
+			}
+		}
+		std::sort(changed.begin(), changed.end());
+		changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+		return changed;
+	}
+#endif
+	auto now = std::chrono::steady_clock::now();
+	if (now >= nextScan) {
+		scan(&changed);
+		nextScan = now + scanInterval;
+	}
+	return changed;
+}
+
+void FileWatcher::scan(std::vector<std::string>* changed) {
+	std::error_code error;
+	for (auto& entry : fs::recursive_directory_iterator(root, error)) {
+		if (!entry.is_regular_file(error)) {
+			continue;
+		}
+		auto time = entry.last_write_time(error);
+		if (error) {
+			continue;
+		}
+		auto name = relative(entry.path());
+		auto known = timestamps.find(name);
+		if (known == timestamps.end() || known->second != time) {
+			timestamps[name] = time;
+			if (changed) {
+				changed->push_back(name);
+			}
+		}
+	}
+}
+
+std::string FileWatcher::relative(const fs::path& path) const {
+	return path.lexically_relative(root).generic_string();
+}
+
+#ifdef __linux__
+void FileWatcher::addWatch(const fs::path& directory) {
+	// Editors often save by writing a temporary file and renaming it over the original
+	int watch = inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (watch >= 0) {
+		watches[watch] = directory;
+	}
+}
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Reports files written below a directory. Uses inotify on Linux and falls back to
+// comparing modification times a couple of times per second everywhere else.
+class FileWatcher
+{
+public:
+	explicit FileWatcher(const std::string& directory);
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// Files changed since the last call, relative to the directory with '/' separators.
+	// Never blocks, each path is reported once per call.
+	std::vector<std::string> poll();
+
+private:
+	void scan(std::vector<std::string>* changed);
+	std::string relative(const std::filesystem::path& path) const;
+
+	std::filesystem::path root;
+
+#ifdef __linux__
+	void addWatch(const std::filesystem::path& directory);
+	int inotify = -1;
+	std::unordered_map<int, std::filesystem::path> watches;
+#endif
+
+	// Polling fallback
+	std::unordered_map<std::string, std::filesystem::file_time_type> timestamps;
+	std::chrono::steady_clock::time_point nextScan;
+};
@@ -0,0 +1,76 @@
+#include "input.h"
+#include "parser.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+bool parseCommandType(const std::string& name, Command::Type& type) {
+	static const std::map<std::string, Command::Type> names = {
+		{ "Left", Command::Left },
+		{ "Right", Command::Right },
+		{ "Up", Command::Up },
+		{ "Down", Command::Down },
+		{ "Fire", Command::Fire },
+		{ "Pause", Command::Pause },
+		{ "Restart", Command::Restart },
+		{ "SaveState", Command::SaveState },
+		{ "LoadState", Command::LoadState },
+		{ "Rewind", Command::Rewind },
+		{ "DebugTextures", Command::DebugTextures },
+		{ "DebugBoxes", Command::DebugBoxes },
+		{ "DebugGrid", Command::DebugGrid },
+		{ "DebugPerf", Command::DebugPerf },
+	};
+	auto it = names.find(name);
+	if (it == names.end()) {
+		return false;
+	}
+	type = it->second;
+	return true;
+}
+
+ScriptedInput::ScriptedInput(const std::string& path) {
+	parser_map parsers;
+	auto parseCommand = [this](auto instruction, auto& stream) {
+		Entry entry;
+		std::string name;
+		if (!(stream >> entry.tick >> name) || !parseCommandType(name, entry.command.type)) {
+			throw stream.error("Input script included faulty " + std::string(instruction) + " instruction");
+		}
+		// Optional player index, defaults to the first player
+		int player = 0;
+		if (stream >> player) {
+			entry.command.player = (uint8_t)player;
+		}
+		entry.command.ended = instruction == "Release";
+		entries.push_back(entry);
+	};
+	parsers["Press"] = parseCommand;
+	parsers["Release"] = parseCommand;
+	parsers["Quit"] = [this](auto instruction, auto& stream) {
+		if (!(stream >> quitTick)) {
+			throw stream.error("Input script included faulty quit instruction");
+		}
+	};
+	generic_parser(path, parsers);
+
+	// Keep the script order for commands on the same tick
+	std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.tick < b.tick;
+	});
+}
+
+bool ScriptedInput::poll(int tick, Command& command) {
+	if (next >= entries.size() || entries[next].tick > tick) {
+		return false;
+	}
+	command = entries[next++].command;
+	return true;
+}
+
+bool ScriptedInput::finished(int tick) const {
+	if (quitTick >= 0) {
+		return tick >= quitTick;
+	}
+	return next >= entries.size() && (entries.empty() || tick > entries.back().tick);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "commands.h"
+
+// Parses a command name as used in input scripts ("Left", "Fire", "DebugBoxes", ...)
+bool parseCommandType(const std::string& name, Command::Type& type);
+
+// Replays a fixed sequence of commands on specific simulation ticks, used instead of a keyboard when running headless.
+//
+// Script format:
+// Press <tick> <command> [player]
+// Release <tick> <command> [player]
+// Quit <tick>
+// Without a Quit the script finishes on the tick after its last command.
+class ScriptedInput
+{
+public:
+	ScriptedInput() = default;
+	ScriptedInput(const std::string& path);
+
+	// Fetches the next command scheduled for the given tick, returns false when there are none left for this tick
+	bool poll(int tick, Command& command);
+	// True once the script has asked to stop, or ran out of commands without a Quit
+	bool finished(int tick) const;
+
+private:
+	struct Entry
+	{
+		int tick;
+		Command command;
+	};
+
+	std::vector<Entry> entries;
+	size_t next = 0;
+	int quitTick = -1;
+};
@@ -0,0 +1,134 @@
+#include "mappedfile.h"
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+	// Shared for deletion so a rebuilt file can be moved over the one mapped here
+	HANDLE fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+	file = fileHandle;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize)) {
+		close();
+		throw std::runtime_error("Failed to read the size of " + path);
+	}
+	length = (size_t)fileSize.QuadPart;
+	if (length == 0) {
+		close();
+		throw std::runtime_error("Can't map empty file " + path);
+	}
+
+	mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		close();
+		throw std::runtime_error("Failed to map " + path);
+	}
+	bytes = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (bytes == nullptr) {
+		close();
+		throw std::runtime_error("Failed to map " + path);
+	}
+}
+
+void MappedFile::close() {
+	if (bytes) {
+		UnmapViewOfFile(bytes);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	if (file) {
+		CloseHandle(file);
+	}
+	bytes = nullptr;
+	length = 0;
+	mapping = nullptr;
+	file = nullptr;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+	: bytes(std::exchange(other.bytes, nullptr))
+	, length(std::exchange(other.length, 0))
+	, file(std::exchange(other.file, nullptr))
+	, mapping(std::exchange(other.mapping, nullptr)) {
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		close();
+		bytes = std::exchange(other.bytes, nullptr);
+		length = std::exchange(other.length, 0);
+		file = std::exchange(other.file, nullptr);
+		mapping = std::exchange(other.mapping, nullptr);
+	}
+	return *this;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+
+	struct stat info;
+	if (fstat(descriptor, &info) != 0 || info.st_size == 0) {
+		::close(descriptor);
+		throw std::runtime_error("Can't map empty or unreadable file " + path);
+	}
+	length = (size_t)info.st_size;
+
+	// The mapping keeps its own reference to the file
+	void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	::close(descriptor);
+	if (address == MAP_FAILED) {
+		length = 0;
+		throw std::runtime_error("Failed to map " + path);
+	}
+	bytes = (const uint8_t*)address;
+}
+
+void MappedFile::close() {
+	if (bytes) {
+		munmap((void*)bytes, length);
+	}
+	bytes = nullptr;
+	length = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+	: bytes(std::exchange(other.bytes, nullptr))
+	, length(std::exchange(other.length, 0)) {
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		close();
+		bytes = std::exchange(other.bytes, nullptr);
+		length = std::exchange(other.length, 0);
+	}
+	return *this;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
@@ -1,32 +1,174 @@
 #include "parser.h"
+#include <fstream>
+
+static bool isSpace(char character) {
+	return character == ' ' || character == '\t' || character == '\r' || character == '\v' || character == '\f';
+}
+
+bool ParserLine::next(std::string_view& token) {
+	if (failed) {
+		return false;
+	}
+	while (position < text.size() && isSpace(text[position])) {
+		position++;
+	}
+	column = position + 1;
+	if (position == text.size()) {
+		failed = true;
+		return false;
+	}
+	size_t start = position;
+	while (position < text.size() && !isSpace(text[position])) {
+		position++;
+	}
+	token = text.substr(start, position - start);
+	return true;
+}
+
+ParserLine& ParserLine::operator>>(std::string_view& value) {
+	next(value);
+	return *this;
+}
+
+ParserLine& ParserLine::operator>>(std::string& value) {
+	std::string_view token;
+	if (next(token)) {
+		value.assign(token.data(), token.size());
+	}
+	return *this;
+}
+
+void ParserLine::failAt(std::string_view token) {
+	failed = true;
+	column = token.data() - text.data() + 1;
+}
+
+ParseError ParserLine::error(const std::string& message) const {
+	return ParseError(source ? *source : std::string("<text>"), location.line, column, message);
+}
+
+ParserText::ParserText(std::string_view text, const std::string& source, ParserLocation start)
+	: text(text)
+	, source(&source)
+	, location(start) {
+}
+
+bool ParserText::next(ParserLine& line) {
+	if (location.offset >= text.size()) {
+		return false;
+	}
+	size_t end = text.find('\n', location.offset);
+	if (end == std::string_view::npos) {
+		end = text.size();
+	}
+	line = ParserLine(text.substr(location.offset, end - location.offset), source, location);
+	location.offset = end + 1;
+	location.line++;
+	return true;
+}
+
+// FNV-1a with the seed folded into the offset basis
+static uint32_t hashInstruction(std::string_view name, uint32_t seed) {
+	uint32_t hash = 2166136261u ^ (seed * 16777619u);
+	for (char character : name) {
+		hash ^= (uint8_t)character;
+		hash *= 16777619u;
+	}
+	return hash ^ (hash >> 16);
+}
+
+parser_function& parser_map::operator[](std::string_view name) {
+	for (auto& parser : parsers) {
+		if (parser.first == name) {
+			return parser.second;
+		}
+	}
+	parsers.emplace_back(std::string(name), parser_function());
+	rebuild();
+	return parsers.back().second;
+}
+
+const parser_function* parser_map::find(std::string_view name) const {
+	if (slots.empty()) {
+		return nullptr;
+	}
+	int32_t slot = slots[hashInstruction(name, seed) & (slots.size() - 1)];
+	if (slot < 0 || parsers[slot].first != name) {
+		return nullptr;
+	}
+	return &parsers[slot].second;
+}
+
+void parser_map::rebuild() {
+	// Instruction sets are small and built once, so searching for a collision free seed is cheap
+	size_t size = 1;
+	while (size < parsers.size()) {
+		size *= 2;
+	}
+	while (true) {
+		for (seed = 0; seed < 64; seed++) {
+			slots.assign(size, -1);
+			bool collision = false;
+			for (size_t i = 0; i < parsers.size() && !collision; i++) {
+				auto& slot = slots[hashInstruction(parsers[i].first, seed) & (size - 1)];
+				collision = slot >= 0;
+				slot = (int32_t)i;
+			}
+			if (!collision) {
+				return;
+			}
+		}
+		size *= 2;
+	}
+}
+
+std::string read_text_file(const std::string& filepath) {
+	std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open " + filepath);
+	}
+	std::string text((size_t)file.tellg(), '\0');
+	file.seekg(0);
+	if (!file.read(text.data(), text.size())) {
+		throw std::runtime_error("Failed to read " + filepath);
+	}
+	return text;
+}
+
+bool generic_parse_line(ParserLine& line, const parser_map& parsers, const parser_function& unknown) {
+	std::string_view instruction;
+	// Check for reasons to skip the line
+	if (
+		!line.next(instruction) || // line is empty
+		(instruction[0] == '#') // line is comment (starts with #)
+	) {
+		return false;
+	}
+
+	auto parser = parsers.find(instruction);
+	(parser ? *parser : unknown)(instruction, line);
+	return true;
+}
 
 void generic_parser(const std::string& filepath, const parser_map& parsers) {
-	return generic_parser(filepath, parsers, [](const std::string& instruction, std::istringstream& line) {
-		throw std::runtime_error("Unknown instruction type '" + instruction + "'");
+	return generic_parser(filepath, parsers, [](std::string_view instruction, ParserLine& line) {
+		throw line.error("Unknown instruction type '" + std::string(instruction) + "'");
 	});
 }
 
 void generic_parser(const std::string& filepath, const parser_map& parsers, const parser_function& unknown) {
-	std::ifstream file(filepath);
-	if (!file.is_open()) {
-		throw std::runtime_error("Failed to open level file");
-	}
-
-	// Parse line-by-line
-	std::string lineText;
-	while (file.good() && std::getline(file, lineText)) {
-		std::istringstream line(lineText);
-		std::string instruction;
-		// Check for reasons to skip the line
-		if (
-			!(line >> instruction) || // line is empty
-			(instruction[0] == '#') // line is comment (starts with #)
-		) {
-			continue;
+	// One read for the whole file, lines and tokens are views into it
+	std::string text = read_text_file(filepath);
+	ParserText lines(text, filepath);
+	ParserLine line;
+	while (lines.next(line)) {
+		try {
+			generic_parse_line(line, parsers, unknown);
+		} catch (const ParseError&) {
+			throw;
+		} catch (const std::exception& error) {
+			// Errors raised by the parsers themselves get the position of the line
+			throw line.error(error.what());
 		}
-
-		auto it = parsers.find(instruction);
-		auto& parser = it != parsers.end() ? it->second : unknown;
-		parser(instruction, line);
 	}
 }
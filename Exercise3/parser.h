@@ -1,17 +1,119 @@
 #pragma once
 
-#include <filesystem>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
-#include <fstream>
-#include <iostream>
-#include <map>
-#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-namespace fs = std::filesystem;
+// Thrown for malformed input, the message starts with "<source>:<line>:<column>: "
+class ParseError : public std::runtime_error
+{
+public:
+	ParseError(const std::string& source, size_t line, size_t column, const std::string& message)
+		: std::runtime_error(source + ":" + std::to_string(line) + ":" + std::to_string(column) + ": " + message) {
+	}
+};
 
-typedef std::function<void(const std::string& instruction, std::istringstream& line)> parser_function;
-typedef std::map<std::string, parser_function> parser_map;
+// Where a line starts in the parsed text, to come back to it later
+struct ParserLocation
+{
+	size_t offset = 0; // bytes from the start of the text
+	size_t line = 1;
+};
+
+// Whitespace separated tokens of one line. Tokens are views into the parsed text and numbers are
+// read with std::from_chars, so nothing is copied or allocated unless a token is read into a std::string.
+// Works like an istream: once a read fails the line stays failed and converts to false.
+class ParserLine
+{
+public:
+	ParserLine() = default;
+	ParserLine(std::string_view text, const std::string* source, ParserLocation location)
+		: text(text)
+		, source(source)
+		, location(location) {
+	}
+
+	// Next token, false at the end of the line
+	bool next(std::string_view& token);
+
+	ParserLine& operator>>(std::string_view& value);
+	ParserLine& operator>>(std::string& value);
+	template<typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+	ParserLine& operator>>(T& value) {
+		std::string_view token;
+		if (next(token)) {
+			auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+			if (result.ec != std::errc() || result.ptr != token.data() + token.size()) {
+				failAt(token);
+			}
+		}
+		return *this;
+	}
+
+	explicit operator bool() const { return !failed; }
+	bool operator!() const { return failed; }
+
+	ParserLocation getLocation() const { return location; }
+	// Error at the token that failed to read, or at the last token read
+	ParseError error(const std::string& message) const;
+
+private:
+	void failAt(std::string_view token);
+
+	std::string_view text;
+	const std::string* source = nullptr;
+	ParserLocation location;
+	size_t position = 0;
+	size_t column = 1; // of the last token read, or where reading failed
+	bool failed = false;
+};
+
+// Splits text into lines, text and source name have to outlive the lines handed out
+class ParserText
+{
+public:
+	ParserText(std::string_view text, const std::string& source, ParserLocation start = ParserLocation());
+
+	// Next line, false at the end of the text
+	bool next(ParserLine& line);
+
+private:
+	std::string_view text;
+	const std::string* source;
+	ParserLocation location;
+};
+
+typedef std::function<void(std::string_view instruction, ParserLine& line)> parser_function;
+
+// Instruction parsers by name. Lookups go through a perfect hash: every name gets its own
+// slot, so finding an instruction costs one hash and at most one string compare.
+class parser_map
+{
+public:
+	parser_function& operator[](std::string_view name);
+	const parser_function* find(std::string_view name) const;
+
+private:
+	void rebuild();
+
+	std::deque<std::pair<std::string, parser_function>> parsers; // stable, operator[] hands out references
+	std::vector<int32_t> slots; // index into parsers, -1 when empty
+	uint32_t seed = 0;
+};
+
+// Reads a whole file, throws when it can't be opened
+std::string read_text_file(const std::string& filepath);
+
+// Dispatches a single line to its parser, returns false for empty lines and comments
+bool generic_parse_line(ParserLine& line, const parser_map& parsers, const parser_function& unknown);
 
 void generic_parser(const std::string& filepath, const parser_map& parsers);
 void generic_parser(const std::string& filepath, const parser_map& parsers, const parser_function& unknown);
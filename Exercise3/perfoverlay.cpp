@@ -0,0 +1,138 @@
+#include "perfoverlay.h"
+#include "allocations.h"
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+
+static const vec2 panelPosition(10, 10);
+static const float panelWidth = 520;
+static const float padding = 8;
+static const float barLeft = 280; // from the left of the panel
+static const float barWidth = panelWidth - barLeft - padding;
+static const unsigned int characterSize = 16;
+// Frame time graph, the full height is two frames at 60 Hz
+static const float graphLines = 4;
+static const float graphMilliseconds = 1000.0f / 30;
+static const float targetMilliseconds = 1000.0f / 60;
+
+void PerfStats::clear() {
+	visible = false;
+	font = nullptr;
+	tickBudget = 0;
+	tickTime = 0;
+	tickAllocations = 0;
+	systems.clear();
+	entities = 0;
+	tags.clear();
+	components.clear();
+}
+
+void PerfOverlay::beginFrame() {
+	auto now = std::chrono::steady_clock::now();
+	uint64_t allocations = threadAllocations();
+	if (frameStart != std::chrono::steady_clock::time_point()) {
+		frameTimes[frameIndex] = std::chrono::duration<float, std::milli>(now - frameStart).count();
+		frameIndex = (frameIndex + 1) % frameCount;
+		frameAllocations = allocations - frameStartAllocations - overlayAllocations;
+	}
+	frameStart = now;
+	frameStartAllocations = allocations;
+	overlayAllocations = 0;
+}
+
+void PerfOverlay::addQuad(const vec2& position, const vec2& size, const sf::Color& color) {
+	quads.append(sf::Vertex(position, color));
+	quads.append(sf::Vertex(position + vec2(size.x, 0), color));
+	quads.append(sf::Vertex(position + size, color));
+	quads.append(sf::Vertex(position + vec2(0, size.y), color));
+}
+
+void PerfOverlay::addBar(float fraction, const sf::Color& color) {
+	vec2 position = panelPosition + vec2(barLeft, padding + lines * lineHeight + lineHeight * 0.2f);
+	addQuad(position, vec2(barWidth * std::clamp(fraction, 0.0f, 1.0f), lineHeight * 0.6f), color);
+}
+
+void PerfOverlay::endLine() {
+	label << '\n';
+	lines++;
+}
+
+void PerfOverlay::draw(sf::RenderTarget& target, const PerfStats& stats, int drawCalls, int batches) {
+	if (!stats.font) {
+		return;
+	}
+	uint64_t allocations = threadAllocations();
+	lineHeight = stats.font->getLineSpacing(characterSize);
+	quads.clear();
+	label.str("");
+	label << std::fixed << std::setprecision(1);
+	lines = 0;
+	// The panel goes first so everything else is drawn on top of it, its height is known at the end
+	addQuad(panelPosition, vec2(panelWidth, 0), sf::Color(0, 0, 0, 190));
+
+	// Frame times, oldest on the left
+	float average = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0f) / frameCount;
+	float slowest = *std::max_element(frameTimes.begin(), frameTimes.end());
+	float latest = frameTimes[(frameIndex + frameCount - 1) % frameCount];
+	label << "Frame " << latest << " ms, avg " << average << ", max " << slowest;
+	endLine();
+	float graphHeight = graphLines * lineHeight;
+	vec2 graphBottom = panelPosition + vec2(padding, padding + lines * lineHeight + graphHeight);
+	float graphBarWidth = (panelWidth - padding * 2) / frameCount;
+	for (size_t i = 0; i < frameCount; i++) {
+		float time = frameTimes[(frameIndex + i) % frameCount];
+		float height = std::min(time / graphMilliseconds, 1.0f) * graphHeight;
+		sf::Color color = time > targetMilliseconds * 2 ? sf::Color::Red : time > targetMilliseconds * 1.1f ? sf::Color::Yellow : sf::Color::Green;
+		addQuad(graphBottom + vec2(i * graphBarWidth, -height), vec2(graphBarWidth, height), color);
+	}
+	float targetY = graphBottom.y - targetMilliseconds / graphMilliseconds * graphHeight;
+	addQuad(vec2(graphBottom.x, targetY), vec2(panelWidth - padding * 2, 1), sf::Color::White);
+	for (int i = 0; i < graphLines; i++) {
+		endLine();
+	}
+
+	label << std::setprecision(0);
+	label << "Tick " << stats.tickTime << " us of " << stats.tickBudget;
+	addBar(stats.tickTime / stats.tickBudget, sf::Color::Cyan);
+	endLine();
+	label << "Draw calls " << drawCalls << ", batches " << batches;
+	endLine();
+	label << "Allocations per tick " << stats.tickAllocations << ", per frame " << frameAllocations;
+	endLine();
+
+	// Systems against the tick budget
+	label << "Systems, us";
+	endLine();
+	for (auto& system : stats.systems) {
+		label << "  " << system.first << " " << system.second;
+		addBar(system.second / stats.tickBudget, sf::Color::Cyan);
+		endLine();
+	}
+
+	label << "Entities " << stats.entities;
+	endLine();
+	for (auto& tag : stats.tags) {
+		label << "  " << tag.first << " " << tag.second;
+		addBar(stats.entities > 0 ? (float)tag.second / stats.entities : 0, sf::Color::Magenta);
+		endLine();
+	}
+	label << "Components";
+	endLine();
+	for (auto& component : stats.components) {
+		label << "  " << component.first << " " << component.second << " of " << stats.entities;
+		addBar(stats.entities > 0 ? (float)component.second / stats.entities : 0, sf::Color(100, 140, 255));
+		endLine();
+	}
+
+	float panelHeight = lines * lineHeight + padding * 2;
+	quads[2].position.y = quads[3].position.y = panelPosition.y + panelHeight;
+
+	text.setFont(*stats.font);
+	text.setCharacterSize(characterSize);
+	text.setFillColor(sf::Color::White);
+	text.setString(label.str());
+	text.setPosition(panelPosition + vec2(padding, padding));
+	target.draw(quads);
+	target.draw(text);
+	overlayAllocations += threadAllocations() - allocations;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <utility>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "geometry.h"
+
+// Numbers shown by the performance overlay, filled in by the scene while the overlay is on. Names are string literals.
+struct PerfStats
+{
+	bool visible = false;
+	const sf::Font* font = nullptr;
+	float tickBudget = 0; // microseconds
+	float tickTime = 0; // microseconds, of the latest tick
+	uint64_t tickAllocations = 0;
+	std::vector<std::pair<const char*, float>> systems; // microseconds spent in the latest tick
+	int entities = 0;
+	std::vector<std::pair<const char*, int>> tags; // entities with each tag
+	std::vector<std::pair<const char*, int>> components; // entities with each component
+
+	void clear();
+};
+
+// Frame times, draw counts and the scene's PerfStats in the top left corner. All bars are one batch of quads
+// and all labels one text, so the overlay adds two draw calls and leaves the numbers it shows alone.
+class PerfOverlay
+{
+public:
+	// Called by the render thread at the start of every frame, shown or not
+	void beginFrame();
+	// Draw calls and batches of the previous frame, without the overlay's own
+	void draw(sf::RenderTarget& target, const PerfStats& stats, int drawCalls, int batches);
+
+private:
+	void addQuad(const vec2& position, const vec2& size, const sf::Color& color);
+	// Bar next to the current line, fraction of the full bar width
+	void addBar(float fraction, const sf::Color& color);
+	void endLine();
+
+	static constexpr size_t frameCount = 240;
+	std::array<float, frameCount> frameTimes = {}; // milliseconds, oldest at frameIndex
+	size_t frameIndex = 0;
+	std::chrono::steady_clock::time_point frameStart;
+	uint64_t frameStartAllocations = 0;
+	uint64_t frameAllocations = 0; // of the previous frame, without the overlay's own
+	uint64_t overlayAllocations = 0;
+
+	sf::VertexArray quads = sf::VertexArray(sf::Quads);
+	sf::Text text;
+	std::ostringstream label;
+	int lines = 0;
+	float lineHeight = 0;
+};
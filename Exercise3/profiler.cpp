@@ -0,0 +1,253 @@
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+std::atomic<bool> Profiler::enabledFlag = false;
+
+// Zones kept per thread, about 1.5 MiB each
+static constexpr size_t eventCapacity = 1 << 16;
+static constexpr size_t eventMask = eventCapacity - 1;
+
+// Slots are read while their thread may overwrite them, relaxed atomics make that a stale read instead of a race
+struct ProfileSlot
+{
+	std::atomic<const char*> name;
+	std::atomic<uint64_t> start;
+	std::atomic<uint64_t> end;
+	std::atomic<bool> frame;
+};
+
+// Written by its thread only, read by collect() from any thread
+struct ProfileBuffer
+{
+	std::string name;
+	std::atomic<size_t> written = 0;
+	std::unique_ptr<ProfileSlot[]> slots = std::make_unique<ProfileSlot[]>(eventCapacity);
+};
+
+static const auto epoch = std::chrono::steady_clock::now();
+// Buffers outlive their threads, so zones of threads that finished can still be collected
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<ProfileBuffer>> buffers;
+static thread_local ProfileBuffer* threadBuffer = nullptr;
+
+static ProfileBuffer& currentBuffer() {
+	if (!threadBuffer) {
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		buffers.push_back(std::make_unique<ProfileBuffer>());
+		threadBuffer = buffers.back().get();
+		threadBuffer->name = "Thread " + std::to_string(buffers.size());
+	}
+	return *threadBuffer;
+}
+
+static ProfileEvent readSlot(const ProfileSlot& slot) {
+	ProfileEvent event;
+	event.name = slot.name.load(std::memory_order_relaxed);
+	event.start = slot.start.load(std::memory_order_relaxed);
+	event.end = slot.end.load(std::memory_order_relaxed);
+	event.frame = slot.frame.load(std::memory_order_relaxed);
+	return event;
+}
+
+static float durationMicroseconds(const ProfileEvent& event) {
+	return (event.end - event.start) / 1000.0f;
+}
+
+void Profiler::setThreadName(const std::string& name) {
+	auto& buffer = currentBuffer();
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	buffer.name = name;
+}
+
+uint64_t Profiler::now() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::record(const ProfileEvent& event) {
+	auto& buffer = currentBuffer();
+	size_t index = buffer.written.load(std::memory_order_relaxed);
+	auto& slot = buffer.slots[index & eventMask];
+	slot.name.store(event.name, std::memory_order_relaxed);
+	slot.start.store(event.start, std::memory_order_relaxed);
+	slot.end.store(event.end, std::memory_order_relaxed);
+	slot.frame.store(event.frame, std::memory_order_relaxed);
+	buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::lastFrame(std::vector<ProfileEvent>& events) {
+	events.clear();
+	auto& buffer = currentBuffer();
+	size_t end = buffer.written.load(std::memory_order_relaxed);
+	size_t begin = end > eventCapacity ? end - eventCapacity : 0;
+	// Recorded when they end, the zones of a frame come right before it
+	size_t frame = end;
+	while (frame > begin && !buffer.slots[(frame - 1) & eventMask].frame.load(std::memory_order_relaxed)) {
+		frame--;
+	}
+	if (frame == begin) {
+		return;
+	}
+	events.push_back(readSlot(buffer.slots[(frame - 1) & eventMask]));
+	for (size_t i = frame - 1; i > begin; i--) {
+		auto event = readSlot(buffer.slots[(i - 1) & eventMask]);
+		if (event.start < events.front().start) {
+			break;
+		}
+		events.push_back(event);
+	}
+}
+
+std::vector<ProfileThread> Profiler::collect() {
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	std::vector<ProfileThread> threads;
+	threads.reserve(buffers.size());
+	for (auto& buffer : buffers) {
+		ProfileThread thread;
+		thread.name = buffer->name;
+		size_t end = buffer->written.load(std::memory_order_acquire);
+		size_t begin = end > eventCapacity ? end - eventCapacity : 0;
+		thread.events.reserve(end - begin);
+		for (size_t i = begin; i < end; i++) {
+			thread.events.push_back(readSlot(buffer->slots[i & eventMask]));
+		}
+		// The thread kept recording while the zones were copied, the oldest ones may have been overwritten.
+		// The slot of the next zone counts as overwritten, it may be written to right now.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		size_t written = buffer->written.load(std::memory_order_relaxed) + 1;
+		size_t oldest = written > eventCapacity ? written - eventCapacity : 0;
+		if (oldest > begin) {
+			thread.events.erase(thread.events.begin(), thread.events.begin() + std::min(oldest - begin, thread.events.size()));
+		}
+		threads.push_back(std::move(thread));
+	}
+	return threads;
+}
+
+std::vector<ProfileStats> Profiler::stats(const std::vector<ProfileThread>& threads) {
+	std::vector<ProfileStats> result;
+	for (auto& thread : threads) {
+		// Zones are recorded when they end, so nested ones come before the zones around them
+		std::vector<ProfileEvent> frames;
+		std::vector<ProfileEvent> zones;
+		for (auto& event : thread.events) {
+			(event.frame ? frames : zones).push_back(event);
+		}
+		auto byStart = [](const ProfileEvent& a, const ProfileEvent& b) {
+			return a.start < b.start;
+		};
+		std::sort(frames.begin(), frames.end(), byStart);
+		std::sort(zones.begin(), zones.end(), byStart);
+
+		std::map<std::string, std::vector<float>> samples;
+		std::map<std::string, size_t> appearances;
+		for (auto& frame : frames) {
+			samples[frame.name].push_back(durationMicroseconds(frame));
+		}
+		// Totals of the frame being summed up, zones that ran in some frames only get 0 for the others below
+		std::map<std::string, float> totals;
+		std::map<std::string, std::vector<float>> frameTotals;
+		size_t frame = 0;
+		size_t totalsFrame = SIZE_MAX;
+		auto flush = [&]() {
+			for (auto& total : totals) {
+				frameTotals[total.first].push_back(total.second);
+			}
+			totals.clear();
+		};
+		for (auto& zone : zones) {
+			while (frame < frames.size() && frames[frame].end < zone.start) {
+				frame++;
+			}
+			if (frame == frames.size() || frames[frame].start > zone.start || frames[frame].end < zone.end) {
+				samples[zone.name].push_back(durationMicroseconds(zone));
+				appearances[zone.name]++;
+				continue;
+			}
+			if (frame != totalsFrame) {
+				flush();
+				totalsFrame = frame;
+			}
+			totals[zone.name] += durationMicroseconds(zone);
+		}
+		flush();
+		for (auto& pair : frameTotals) {
+			// Samples from outside of frames may already be there, the zeros only stand in for frames
+			auto& zoneSamples = samples[pair.first];
+			appearances[pair.first] += pair.second.size();
+			zoneSamples.insert(zoneSamples.end(), pair.second.begin(), pair.second.end());
+			zoneSamples.insert(zoneSamples.end(), frames.size() - pair.second.size(), 0.0f);
+		}
+		for (auto& frame : frames) {
+			appearances[frame.name]++;
+		}
+
+		for (auto& pair : samples) {
+			auto& sorted = pair.second;
+			std::sort(sorted.begin(), sorted.end());
+			ProfileStats stats;
+			stats.thread = thread.name;
+			stats.name = pair.first;
+			stats.frames = sorted.size();
+			stats.appearances = appearances[pair.first];
+			stats.min = sorted.front();
+			stats.max = sorted.back();
+			float sum = 0;
+			for (float sample : sorted) {
+				sum += sample;
+			}
+			stats.average = sum / sorted.size();
+			stats.p99 = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+			result.push_back(stats);
+		}
+	}
+	return result;
+}
+
+void Profiler::printStats(std::ostream& stream, const std::vector<ProfileStats>& stats) {
+	for (auto& zone : stats) {
+		stream << zone.thread << ", " << zone.name << ": " << zone.frames << " samples, ran in " << zone.appearances << ", min " << zone.min << "us, avg "
+			<< zone.average << "us, p99 " << zone.p99 << "us, max " << zone.max << "us" << std::endl;
+	}
+}
+
+static void writeJsonString(std::ostream& stream, const std::string& text) {
+	stream << '"';
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			stream << '\\';
+		}
+		stream << c;
+	}
+	stream << '"';
+}
+
+void Profiler::writeChromeTrace(const std::string& path, const std::vector<ProfileThread>& threads) {
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to write trace " + path);
+	}
+	// Complete events with times in microseconds, threads named by metadata events
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	for (size_t tid = 0; tid < threads.size(); tid++) {
+		auto& thread = threads[tid];
+		file << (tid == 0 ? "" : ",") << "\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+		writeJsonString(file, thread.name);
+		file << "}}";
+		for (auto& event : thread.events) {
+			file << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"name\":";
+			writeJsonString(file, event.name);
+			file << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+		}
+	}
+	file << "\n]}\n";
+	if (!file) {
+		throw std::runtime_error("Failed to write trace " + path);
+	}
+}
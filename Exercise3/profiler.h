@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Scoped timing zones, kept per thread in a ring buffer of the most recent ones. Off by default, a zone then
+// costs a relaxed load and a branch. The zones can be written out as a Chrome trace (chrome://tracing, Perfetto)
+// or summed up per frame: every zone inside a frame zone counts towards that frame.
+
+struct ProfileEvent
+{
+	const char* name = nullptr; // string literal
+	uint64_t start = 0; // nanoseconds since the profiler started
+	uint64_t end = 0;
+	bool frame = false;
+};
+
+// Zones recorded by one thread, oldest first
+struct ProfileThread
+{
+	std::string name;
+	std::vector<ProfileEvent> events;
+};
+
+// Time spent in a zone per frame, in microseconds. Frames the zone didn't run in count as 0.
+struct ProfileStats
+{
+	std::string thread;
+	std::string name;
+	size_t frames = 0;
+	size_t appearances = 0; // samples the zone ran in
+	float min = 0;
+	float average = 0;
+	float p99 = 0;
+	float max = 0;
+};
+
+class Profiler
+{
+public:
+	static void setEnabled(bool enabled) { enabledFlag.store(enabled, std::memory_order_relaxed); }
+	static bool enabled() { return enabledFlag.load(std::memory_order_relaxed); }
+	// Name the calling thread is shown with, threads are numbered otherwise
+	static void setThreadName(const std::string& name);
+
+	static uint64_t now();
+	// Called from the thread the zone ran on, never blocks
+	static void record(const ProfileEvent& event);
+
+	// Zones of the calling thread's latest frame, the frame zone first. Empty when no frame was recorded.
+	static void lastFrame(std::vector<ProfileEvent>& events);
+	// Copies the zones of every thread. Safe while threads keep recording, zones they overwrite meanwhile are left out.
+	static std::vector<ProfileThread> collect();
+	// Per frame totals of every zone in a frame over all frames of its thread, per call for zones outside of frames
+	static std::vector<ProfileStats> stats(const std::vector<ProfileThread>& threads);
+	static void printStats(std::ostream& stream, const std::vector<ProfileStats>& stats);
+	// Throws when the file can't be written
+	static void writeChromeTrace(const std::string& path, const std::vector<ProfileThread>& threads);
+
+private:
+	static std::atomic<bool> enabledFlag;
+};
+
+class ProfileZone
+{
+public:
+	enum Kind { Nested, Frame };
+
+	// The name has to outlive the profiler, use string literals
+	explicit ProfileZone(const char* name, Kind kind = Nested) {
+		if (Profiler::enabled()) {
+			event.name = name;
+			event.start = Profiler::now();
+			event.frame = kind == Frame;
+		}
+	}
+
+	~ProfileZone() {
+		if (event.name) {
+			event.end = Profiler::now();
+			Profiler::record(event);
+		}
+	}
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	ProfileEvent event;
+};
@@ -1,12 +1,104 @@
 // Exercise3.cpp : This file contains the 'main' function. Program execution begins and ends there.
 //
 
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <string>
+#include "assetpack.h"
 #include "engine.h"
+#include "scenes/levelformat.h"
 
-int main()
+int main(int argc, char* argv[])
 {
-	GameEngine engine;
+	EngineSettings settings;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--tickrate" && hasValue) {
+			settings.tickRate = std::stof(argv[++i]);
+			if (!(settings.tickRate > 0)) {
+				std::cerr << "The tick rate has to be above 0" << std::endl;
+				return 1;
+			}
+		} else if (arg == "--catchup" && hasValue) {
+			settings.maxCatchUpTicks = std::stoi(argv[++i]);
+		} else if (arg == "--headless") {
+			settings.headless = true;
+		} else if (arg == "--script" && hasValue) {
+			settings.inputScript = argv[++i];
+		} else if (arg == "--ticks" && hasValue) {
+			settings.maxTicks = std::stoi(argv[++i]);
+		} else if (arg == "--unthrottled") {
+			settings.unthrottled = true;
+		} else if (arg == "--level" && hasValue) {
+			settings.startLevel = argv[++i];
+		} else if (arg == "--chunksize" && hasValue) {
+			settings.chunkSize = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--streamradius" && hasValue) {
+			settings.streamRadius = std::max(0, std::stoi(argv[++i]));
+		} else if (arg == "--streamhysteresis" && hasValue) {
+			settings.streamHysteresis = std::max(0, std::stoi(argv[++i]));
+		} else if (arg == "--texturebudget" && hasValue) {
+			// In MiB
+			settings.textureBudget = std::stoull(argv[++i]) * 1024 * 1024;
+		} else if (arg == "--voices" && hasValue) {
+			settings.soundVoices = std::stoul(argv[++i]);
+		} else if (arg == "--rewind" && hasValue) {
+			settings.rewindSeconds = std::stof(argv[++i]);
+		} else if (arg == "--netplay" && i + 3 < argc) {
+			// <player> <local port> <peer host:port>
+			settings.netPlayer = std::stoi(argv[++i]);
+			settings.netPort = (unsigned short)std::stoul(argv[++i]);
+			settings.netPeer = argv[++i];
+			settings.players = 2;
+		} else if (arg == "--inputdelay" && hasValue) {
+			settings.rollback.inputDelay = std::max(0, std::stoi(argv[++i]));
+		} else if (arg == "--maxrollback" && hasValue) {
+			settings.rollback.maxRollback = std::max(0, std::stoi(argv[++i]));
+		} else if (arg == "--fakenet" && i + 3 < argc) {
+			// <latency ticks> <jitter ticks> <loss 0-1>, headless only
+			settings.fakeLatency = std::max(0, std::stoi(argv[++i]));
+			settings.fakeJitter = std::max(0, std::stoi(argv[++i]));
+			settings.fakeLoss = std::stof(argv[++i]);
+			settings.players = 2;
+		} else if (arg == "--checksumcheck") {
+			// Self-check of the state checksums, runs headless
+			settings.checksumCheck = true;
+			settings.headless = true;
+		} else if (arg == "--record" && hasValue) {
+			settings.recordPath = argv[++i];
+		} else if (arg == "--replay" && hasValue) {
+			settings.replayPath = argv[++i];
+		} else if (arg == "--staterecord" && hasValue) {
+			settings.stateRecordPath = argv[++i];
+		} else if (arg == "--keyframes" && hasValue) {
+			settings.keyframeInterval = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--seek" && i + 2 < argc) {
+			settings.seekPath = argv[++i];
+			settings.seekTick = std::stoi(argv[++i]);
+		} else if (arg == "--profile" && hasValue) {
+			settings.profilePath = argv[++i];
+		} else if (arg == "--hotreload") {
+			settings.hotReload = true;
+		} else if (arg == "--pack" && hasValue) {
+			settings.assetPack = argv[++i];
+		} else if (arg == "--bake" && hasValue) {
+			// Build step: compile the resources into a pack and exit
+			bakeAssetPack("./resources", argv[++i]);
+			return 0;
+		} else if (arg == "--compilelevel" && i + 2 < argc) {
+			// Build step: compile a text level with the chunk size given so far and exit
+			std::string textPath = argv[++i];
+			compileLevel(textPath, argv[++i], settings.chunkSize);
+			return 0;
+		} else {
+			std::cerr << "Unknown argument " << std::quoted(arg) << std::endl;
+			return 1;
+		}
+	}
+
+	GameEngine engine(settings);
 	engine.run();
 }
 
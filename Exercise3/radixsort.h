@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Stable LSD radix sort on a 64-bit key, one byte per pass.
+// Passes over bytes that are identical for every item are skipped, so keys that only use a few bits stay cheap.
+// Scratch is only used as temporary storage, passing the same vector every call avoids reallocating it.
+template<typename T, typename KeyFunction>
+void radixSort(std::vector<T>& items, std::vector<T>& scratch, KeyFunction key) {
+	if (items.size() < 2) return;
+	scratch.resize(items.size());
+
+	for (int shift = 0; shift < 64; shift += 8) {
+		size_t counts[256] = {};
+		for (auto& item : items) {
+			counts[(key(item) >> shift) & 0xFF]++;
+		}
+		// All items share this byte, nothing would move
+		if (counts[(key(items.front()) >> shift) & 0xFF] == items.size()) {
+			continue;
+		}
+
+		size_t offset = 0;
+		for (auto& count : counts) {
+			size_t bucketSize = count;
+			count = offset;
+			offset += bucketSize;
+		}
+		for (auto& item : items) {
+			scratch[counts[(key(item) >> shift) & 0xFF]++] = std::move(item);
+		}
+		items.swap(scratch);
+	}
+}
@@ -0,0 +1,86 @@
+#include "renderer.h"
+
+void RenderSnapshot::clear() {
+	clearColor = sf::Color::Black;
+	previousCamera = vec2::zero();
+	camera = vec2::zero();
+	sprites.clear();
+	texts.clear();
+	lines.clear();
+	perf.clear();
+}
+
+void Renderer::draw(sf::RenderTarget& target, const RenderSnapshot& snapshot, float alpha) {
+	overlay.beginFrame();
+	// The overlay is drawn partway through, it shows the totals of the frame before
+	previousDrawCalls = drawCalls;
+	previousBatches = batches;
+	drawCalls = 0;
+	batches = 0;
+	target.clear(snapshot.clearColor);
+
+	// World space is drawn through the camera, screen space text on top of it
+	vec2 camera = snapshot.previousCamera + (snapshot.camera - snapshot.previousCamera) * alpha;
+	sf::View worldView = target.getDefaultView();
+	worldView.move(camera.x, camera.y);
+	target.setView(worldView);
+
+	const sf::Texture* batchTexture = nullptr;
+	for (auto& instance : snapshot.sprites) {
+		if (instance.texture->getSize().x == 0) {
+			// Not loaded yet or just evicted
+			continue;
+		}
+		// Sprites are drawn one by one, a batch is a run with the same texture that could be drawn at once
+		if (instance.texture != batchTexture) {
+			batchTexture = instance.texture;
+			batches++;
+		}
+		sprite.setTexture(*instance.texture);
+		sprite.setTextureRect(instance.textureRect);
+		sprite.setOrigin(instance.origin);
+		sprite.setRotation(to_degrees(instance.angle));
+		sprite.setScale(instance.scale);
+		sprite.setPosition(instance.previousPosition + (instance.position - instance.previousPosition) * alpha);
+		target.draw(sprite);
+		drawCalls++;
+	}
+
+	if (snapshot.lines.getVertexCount() > 0) {
+		target.draw(snapshot.lines);
+		drawCalls++;
+		batches++;
+	}
+
+	for (auto& instance : snapshot.texts) {
+		if (instance.world) {
+			drawText(target, instance);
+		}
+	}
+
+	target.setView(target.getDefaultView());
+	for (auto& instance : snapshot.texts) {
+		if (!instance.world) {
+			drawText(target, instance);
+		}
+	}
+
+	if (snapshot.perf.visible) {
+		overlay.draw(target, snapshot.perf, previousDrawCalls, previousBatches);
+	}
+}
+
+void Renderer::drawText(sf::RenderTarget& target, const TextInstance& instance) {
+	text.setFont(*instance.font);
+	text.setCharacterSize(instance.characterSize);
+	text.setString(instance.text);
+	text.setFillColor(instance.color);
+	vec2 position = instance.position;
+	if (instance.centered) {
+		position.x -= text.getLocalBounds().width / 2;
+	}
+	text.setPosition(position);
+	target.draw(text);
+	drawCalls++;
+	batches++;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "geometry.h"
+#include "perfoverlay.h"
+
+// Packs the draw order into one sortable number: layer first, then texture to keep batches together, then depth
+inline uint64_t makeDrawKey(uint8_t layer, uint32_t texture, uint32_t depth) {
+	return ((uint64_t)layer << 56) | ((uint64_t)(texture & 0xFFFFFF) << 32) | depth;
+}
+
+struct SpriteInstance
+{
+	const sf::Texture* texture = nullptr;
+	sf::IntRect textureRect;
+	vec2 origin;
+	vec2 previousPosition; // position at the start of the tick, used for interpolation
+	vec2 position;
+	vec2 scale = vec2::one();
+	float angle = 0.0f; // radians
+};
+
+struct TextInstance
+{
+	const sf::Font* font = nullptr;
+	std::string text;
+	unsigned int characterSize = 30;
+	sf::Color color = sf::Color::White;
+	vec2 position;
+	bool centered = false; // position is the top center instead of the top left
+	bool world = false; // position is in world space and moves with the camera, otherwise in screen space
+};
+
+// Everything needed to draw one frame, produced by the simulation thread and drawn by the render thread.
+// Scenes must not hand out pointers to anything that can change while the snapshot is in flight.
+struct RenderSnapshot
+{
+	sf::Color clearColor = sf::Color::Black;
+	std::chrono::steady_clock::time_point tickTime; // moment the tick that produced this snapshot finished
+	vec2 previousCamera; // top left of the view in world space, interpolated like sprites
+	vec2 camera;
+	std::vector<SpriteInstance> sprites;
+	std::vector<TextInstance> texts;
+	sf::VertexArray lines = sf::VertexArray(sf::Lines);
+	PerfStats perf;
+
+	// Empties the snapshot while keeping the allocated capacity
+	void clear();
+};
+
+class Renderer
+{
+public:
+	// Alpha blends sprites from their previous (0) to their current (1) position
+	void draw(sf::RenderTarget& target, const RenderSnapshot& snapshot, float alpha);
+
+private:
+	void drawText(sf::RenderTarget& target, const TextInstance& instance);
+
+	sf::Sprite sprite;
+	sf::Text text;
+	PerfOverlay overlay;
+	// Of the frame being drawn and of the one before, without the overlay's own
+	int drawCalls = 0;
+	int batches = 0;
+	int previousDrawCalls = 0;
+	int previousBatches = 0;
+};
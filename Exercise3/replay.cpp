@@ -0,0 +1,160 @@
+#include "replay.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+
+// "E3IR"
+static const uint32_t recordingMagic = 0x52493345;
+static const uint32_t recordingVersion = 1;
+
+// Command type, released flag and player packed into one byte
+static_assert(Command::DebugPerf < 32, "Command types have to fit in 5 bits");
+
+static uint8_t packCommand(const Command& command) {
+	return (uint8_t)command.type | (command.ended ? 0x20 : 0) | (uint8_t)((command.player & 3) << 6);
+}
+
+static Command unpackCommand(uint8_t packed) {
+	Command command;
+	command.type = (Command::Type)(packed & 0x1f);
+	command.ended = (packed & 0x20) != 0;
+	command.player = packed >> 6;
+	return command;
+}
+
+static uint32_t foldChecksum(uint64_t checksum) {
+	return (uint32_t)(checksum ^ (checksum >> 32));
+}
+
+void writeReplayHeader(SnapshotWriter& writer, const ReplayHeader& header) {
+	writer.writeString(header.level);
+	writer.write(header.tickRate);
+	writer.write((int32_t)header.chunkSize);
+	writer.write((int32_t)header.streamRadius);
+	writer.write((int32_t)header.streamHysteresis);
+	writer.write((int32_t)header.players);
+}
+
+void readReplayHeader(SnapshotReader& reader, ReplayHeader& header) {
+	reader.readString(header.level);
+	reader.read(header.tickRate);
+	header.chunkSize = reader.read<int32_t>();
+	header.streamRadius = reader.read<int32_t>();
+	header.streamHysteresis = reader.read<int32_t>();
+	header.players = reader.read<int32_t>();
+}
+
+InputRecorder::InputRecorder(const std::string& path, const ReplayHeader& header)
+	: file(path, std::ios::binary | std::ios::trunc) {
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to create recording " + path);
+	}
+	SnapshotWriter writer(buffer);
+	writer.write(recordingMagic);
+	writer.write(recordingVersion);
+	writeReplayHeader(writer, header);
+	flush();
+}
+
+InputRecorder::~InputRecorder() {
+	flush();
+}
+
+void InputRecorder::perform(const Command& command) {
+	pending.push_back(command);
+}
+
+void InputRecorder::endTick(uint64_t checksum) {
+	SnapshotWriter writer(buffer);
+	writer.writeVarint(pending.size());
+	for (auto& command : pending) {
+		writer.write(packCommand(command));
+	}
+	writer.write(foldChecksum(checksum));
+	pending.clear();
+	ticks++;
+	// Written in batches, a crash loses at most a few seconds
+	if (buffer.size() >= 4096) {
+		flush();
+	}
+}
+
+void InputRecorder::flush() {
+	file.write((const char*)buffer.data(), buffer.size());
+	file.flush();
+	buffer.clear();
+}
+
+InputReplay::InputReplay(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open recording " + path);
+	}
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	SnapshotReader reader(data);
+	if (reader.read<uint32_t>() != recordingMagic || reader.read<uint32_t>() != recordingVersion) {
+		throw std::runtime_error(path + " is not a recording of this version");
+	}
+	readReplayHeader(reader, header);
+
+	while (!reader.atEnd()) {
+		Tick tick;
+		tick.firstCommand = (uint32_t)commands.size();
+		uint32_t count = (uint32_t)reader.readVarint();
+		for (uint32_t i = 0; i < count; i++) {
+			commands.push_back(unpackCommand(reader.read<uint8_t>()));
+		}
+		reader.read(tick.checksum);
+		ticks.push_back(tick);
+	}
+}
+
+bool InputReplay::poll(Command& command) {
+	if (finished()) {
+		return false;
+	}
+	size_t end = tick + 1 < (int)ticks.size() ? ticks[tick + 1].firstCommand : commands.size();
+	if (nextCommand >= end) {
+		return false;
+	}
+	command = commands[nextCommand++];
+	return true;
+}
+
+void InputReplay::endTick(uint64_t checksum) {
+	if (finished()) {
+		return;
+	}
+	if (divergedTick < 0 && foldChecksum(checksum) != ticks[tick].checksum) {
+		divergedTick = tick;
+		std::cout << "Replay diverged from the recording at tick " << tick << std::endl;
+	}
+	// Commands not polled belong to this tick all the same
+	tick++;
+	nextCommand = tick < (int)ticks.size() ? ticks[tick].firstCommand : commands.size();
+}
+
+void InputReplay::skipTo(int tick) {
+	this->tick = std::clamp(tick, 0, (int)ticks.size());
+	nextCommand = this->tick < (int)ticks.size() ? ticks[this->tick].firstCommand : commands.size();
+}
+
+void TickTimes::add(std::chrono::steady_clock::duration duration) {
+	samples.push_back(std::chrono::duration<float, std::micro>(duration).count());
+}
+
+void TickTimes::print(std::ostream& stream) const {
+	if (samples.empty()) {
+		stream << "no ticks";
+		return;
+	}
+	auto sorted = samples;
+	std::sort(sorted.begin(), sorted.end());
+	float average = std::accumulate(sorted.begin(), sorted.end(), 0.0f) / sorted.size();
+	size_t p99 = std::min(sorted.size() - 1, sorted.size() * 99 / 100);
+	stream << sorted.size() << " ticks, min " << sorted.front() << "us, avg " << average << "us, p99 " << sorted[p99] << "us, max " << sorted.back() << "us";
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "commands.h"
+
+// What a recording needs to play out the same again. The simulation has no randomness, so the level
+// and the settings that change how it is simulated are all there is to it.
+struct ReplayHeader
+{
+	std::string level;
+	float tickRate = 0;
+	int chunkSize = 0;
+	int streamRadius = 0;
+	int streamHysteresis = 0;
+	int players = 1;
+};
+
+class SnapshotWriter;
+class SnapshotReader;
+void writeReplayHeader(SnapshotWriter& writer, const ReplayHeader& header);
+void readReplayHeader(SnapshotReader& reader, ReplayHeader& header);
+
+// Writes the commands performed on every tick together with a checksum of the state after it.
+// A tick without commands takes five bytes.
+class InputRecorder
+{
+public:
+	// Throws when the file can't be created
+	InputRecorder(const std::string& path, const ReplayHeader& header);
+	~InputRecorder();
+
+	// Command performed before the current tick
+	void perform(const Command& command);
+	// Ends the current tick with the state it left behind
+	void endTick(uint64_t checksum);
+	int getTicks() const { return ticks; }
+
+private:
+	void flush();
+
+	std::ofstream file;
+	std::vector<uint8_t> buffer;
+	std::vector<Command> pending;
+	int ticks = 0;
+};
+
+// Feeds a recording back tick by tick and reports the first tick whose state differs from the recording
+class InputReplay
+{
+public:
+	// Throws when the file can't be read or isn't a recording
+	explicit InputReplay(const std::string& path);
+
+	const ReplayHeader& getHeader() const { return header; }
+	bool finished() const { return tick >= (int)ticks.size(); }
+	int getTick() const { return tick; }
+	int getTicks() const { return (int)ticks.size(); }
+	// First tick that ended in a different state than recorded, -1 while in sync
+	int getDivergedTick() const { return divergedTick; }
+	// Continues from the given tick, for starting in the middle of a session
+	void skipTo(int tick);
+
+	// Next command recorded for the current tick, false when there are none left
+	bool poll(Command& command);
+	// Compares the state after the current tick with the recording and moves on to the next tick
+	void endTick(uint64_t checksum);
+
+private:
+	struct Tick
+	{
+		uint32_t firstCommand;
+		uint32_t checksum;
+	};
+
+	ReplayHeader header;
+	std::vector<Command> commands;
+	std::vector<Tick> ticks;
+	int tick = 0;
+	size_t nextCommand = 0;
+	int divergedTick = -1;
+};
+
+// Durations of the ticks of a recorded or replayed session, so runs of the same recording can be compared
+class TickTimes
+{
+public:
+	void add(std::chrono::steady_clock::duration duration);
+	bool empty() const { return samples.empty(); }
+	// Min, average, 99th percentile and max in microseconds
+	void print(std::ostream& stream) const;
+
+private:
+	std::vector<float> samples; // microseconds
+};
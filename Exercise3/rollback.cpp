@@ -0,0 +1,256 @@
+#include "rollback.h"
+#include "engine.h"
+#include <algorithm>
+#include <iostream>
+
+// "RBK1"
+static const uint32_t packetMagic = 0x314b4252;
+
+RollbackSession::RollbackSession(GameEngine* game, Scene_PlayLevel& scene, Transport& transport, int localPlayer, const RollbackSettings& settings)
+	: game(game)
+	, scene(scene)
+	, transport(transport)
+	, localPlayer(localPlayer)
+	, remotePlayer(1 - localPlayer)
+	, settings(settings)
+	, states(window) {
+	if (localPlayer < 0 || localPlayer >= playerCount) {
+		throw std::runtime_error("Rollback sessions are for players 0 and 1, got " + std::to_string(localPlayer));
+	}
+	// Keep the frames that can still be rolled back to and the inputs sent ahead in the rings
+	this->settings.inputDelay = std::clamp(settings.inputDelay, 0, window / 4);
+	this->settings.maxRollback = std::clamp(settings.maxRollback, 0, window / 2);
+	// Nobody has input for the frames before the delay, both peers agree they are empty
+	for (int player = 0; player < playerCount; player++) {
+		for (int i = 0; i < this->settings.inputDelay; i++) {
+			input(player, i) = FrameInput{ i, 0, true };
+		}
+	}
+	remoteConfirmed = this->settings.inputDelay - 1;
+	scene.setDeterministic(true);
+}
+
+void RollbackSession::perform(const Command& command) {
+	uint8_t button = 0;
+	switch (command.type) {
+		case Command::Left: button = Left; break;
+		case Command::Right: button = Right; break;
+		case Command::Up: button = Up; break;
+		case Command::Fire: button = Fire; break;
+		case Command::DebugTextures:
+		case Command::DebugBoxes:
+		case Command::DebugGrid:
+		case Command::DebugPerf:
+			// Only change what is drawn
+			scene.perform(command);
+			return;
+		default:
+			// Pausing, restarting and loading states would have to happen on both peers at once
+			return;
+	}
+	if (command.ended) {
+		localButtons &= ~button;
+	} else {
+		localButtons |= button;
+	}
+}
+
+int RollbackSession::getConfirmedFrame() const {
+	return remoteConfirmed;
+}
+
+bool RollbackSession::advance() {
+	receive();
+	if (!started) {
+		// Both peers have to start from the same state, so no frame runs before the level can be played
+		if (!scene.ready()) {
+			send();
+			return false;
+		}
+		started = true;
+	}
+
+	int inputFrame = frame + settings.inputDelay;
+	auto& local = input(localPlayer, inputFrame);
+	if (local.frame != inputFrame) {
+		local = FrameInput{ inputFrame, localButtons, true };
+	}
+	send();
+
+	if (mispredicted < frame) {
+		rollback(mispredicted);
+	}
+	mispredicted = INT32_MAX;
+
+	if (frame - remoteConfirmed > settings.maxRollback) {
+		stats.stalls++;
+		return false;
+	}
+	simulate(frame);
+	frame++;
+	updateChecksums();
+	return true;
+}
+
+uint8_t RollbackSession::inputFor(int player, int frame) {
+	auto& slot = input(player, frame);
+	if (slot.frame == frame) {
+		return slot.buttons;
+	}
+	// Predict the remote player keeps holding what they held last
+	uint8_t predicted = remoteConfirmed >= 0 ? input(player, remoteConfirmed).buttons : 0;
+	slot = FrameInput{ frame, predicted, false };
+	return predicted;
+}
+
+void RollbackSession::receive() {
+	while (transport.receive(packet)) {
+		try {
+			SnapshotReader reader(packet);
+			if (reader.read<uint32_t>() != packetMagic) {
+				continue;
+			}
+			remoteAcknowledged = std::max(remoteAcknowledged, reader.read<int32_t>());
+			int remoteFrame = reader.read<int32_t>();
+			uint64_t remoteSum = reader.read<uint64_t>();
+			if (remoteFrame > comparedFrame && remoteFrame > remoteChecksumFrame) {
+				remoteChecksumFrame = remoteFrame;
+				remoteChecksum = remoteSum;
+			}
+
+			int first = reader.read<int32_t>();
+			int count = reader.read<uint8_t>();
+			for (int i = 0; i < count; i++) {
+				int inputFrame = first + i;
+				uint8_t buttons = reader.read<uint8_t>();
+				// Duplicates of what arrived before, or too far ahead to keep
+				if (inputFrame <= remoteConfirmed || inputFrame >= remoteConfirmed + window) {
+					continue;
+				}
+				auto& slot = input(remotePlayer, inputFrame);
+				if (slot.frame == inputFrame && slot.confirmed) {
+					continue;
+				}
+				if (slot.frame == inputFrame && slot.buttons != buttons && inputFrame < frame) {
+					mispredicted = std::min(mispredicted, inputFrame);
+				}
+				slot = FrameInput{ inputFrame, buttons, true };
+			}
+		} catch (const std::exception&) {
+			// Truncated, same as lost
+		}
+	}
+
+	while (true) {
+		auto& next = input(remotePlayer, remoteConfirmed + 1);
+		if (next.frame != remoteConfirmed + 1 || !next.confirmed) {
+			break;
+		}
+		remoteConfirmed++;
+	}
+}
+
+void RollbackSession::send() {
+	// Every local input the peer hasn't acknowledged, so a lost packet is made up for by the next one
+	int last = started ? frame + settings.inputDelay : settings.inputDelay - 1;
+	int first = std::max({ remoteAcknowledged + 1, settings.inputDelay, last - window / 2 });
+	int count = std::max(0, last - first + 1);
+
+	packet.clear();
+	SnapshotWriter writer(packet);
+	writer.write(packetMagic);
+	writer.write((int32_t)remoteConfirmed);
+	writer.write((int32_t)checksumFrame);
+	writer.write(checksumFrame >= 0 ? checksums[checksumFrame % window] : 0);
+	writer.write((int32_t)first);
+	writer.write((uint8_t)count);
+	for (int i = 0; i < count; i++) {
+		writer.write(input(localPlayer, first + i).buttons);
+	}
+	transport.send(packet);
+}
+
+void RollbackSession::rollback(int from) {
+	auto start = std::chrono::steady_clock::now();
+	scene.loadState(states[from % window]);
+	// Predictions were made from older inputs, predict again from the latest ones
+	for (int i = from; i < frame; i++) {
+		auto& slot = input(remotePlayer, i);
+		if (slot.frame == i && !slot.confirmed) {
+			slot.frame = -1;
+		}
+	}
+	// The sounds already played the first time round
+	game->setSoundsMuted(true);
+	for (int i = from; i < frame; i++) {
+		simulate(i);
+	}
+	game->setSoundsMuted(false);
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+	int frames = frame - from;
+	stats.rollbacks++;
+	stats.resimulatedFrames += frames;
+	stats.longestRollback = std::max(stats.longestRollback, frames);
+	stats.slowestRollback = std::max(stats.slowestRollback, elapsed);
+	auto budget = std::chrono::duration<double>(1.0 / game->getSettings().tickRate);
+	if (elapsed > budget) {
+		std::cout << "Rollback of " << frames << " frames took " << elapsed.count() << "us, longer than a tick" << std::endl;
+	}
+}
+
+void RollbackSession::simulate(int frame) {
+	scene.saveState(states[frame % window]);
+	// Snapshots hold padding and pointers, the peers compare checksums of the state itself
+	checksums[frame % window] = scene.checksum();
+	static const std::pair<Command::Type, uint8_t> buttons[] = {
+		{ Command::Left, Left },
+		{ Command::Right, Right },
+		{ Command::Up, Up },
+		{ Command::Fire, Fire },
+	};
+	for (int player = 0; player < playerCount; player++) {
+		uint8_t held = inputFor(player, frame);
+		// The full state of every button, so frames play out the same whatever was applied before them
+		for (auto& button : buttons) {
+			Command command;
+			command.type = button.first;
+			command.ended = !(held & button.second);
+			command.player = (uint8_t)player;
+			scene.perform(command);
+		}
+	}
+	scene.tick();
+}
+
+void RollbackSession::updateChecksums() {
+	// A frame's start state is final once every input before it is confirmed, its checksum was taken when it was simulated
+	checksumFrame = std::max(checksumFrame, std::min(remoteConfirmed + 1, frame - 1));
+	if (remoteChecksumFrame >= 0) {
+		compareChecksum(remoteChecksumFrame, remoteChecksum);
+	}
+}
+
+void RollbackSession::compareChecksum(int checkedFrame, uint64_t sum) {
+	if (checkedFrame > checksumFrame) {
+		// Not final here yet, compared once it is
+		return;
+	}
+	remoteChecksumFrame = -1;
+	comparedFrame = checkedFrame;
+	if (checkedFrame <= checksumFrame - window) {
+		return;
+	}
+	if (checksums[checkedFrame % window] != sum) {
+		if (stats.desyncs == 0) {
+			std::cout << "Desync with the peer at frame " << checkedFrame << std::endl;
+		}
+		stats.desyncs++;
+	}
+}
+
+std::ostream& operator<<(std::ostream& stream, const RollbackStats& stats) {
+	return stream << stats.rollbacks << " rollbacks, " << stats.resimulatedFrames << " frames re-simulated, longest "
+		<< stats.longestRollback << " frames, slowest " << stats.slowestRollback.count() << "us, "
+		<< stats.stalls << " ticks stalled, " << stats.desyncs << " desyncs";
+}
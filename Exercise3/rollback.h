@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "commands.h"
+#include "transport.h"
+#include "scenes/playlevel.h"
+
+class GameEngine;
+
+struct RollbackSettings
+{
+	// Ticks between a local input and the frame it applies to, hides that much latency without rolling back
+	int inputDelay = 2;
+	// Ticks simulated ahead of the last confirmed remote input before waiting for it
+	int maxRollback = 8;
+};
+
+struct RollbackStats
+{
+	int rollbacks = 0;
+	int resimulatedFrames = 0;
+	int longestRollback = 0; // frames
+	std::chrono::microseconds slowestRollback = std::chrono::microseconds::zero();
+	int stalls = 0; // ticks spent waiting for the remote player
+	int desyncs = 0;
+};
+
+std::ostream& operator<<(std::ostream& stream, const RollbackStats& stats);
+
+// Two player session over an unreliable transport. Both peers simulate every frame right away, predicting
+// that the remote player keeps holding what they held last. When the real input turns out different the
+// scene is restored to the frame it changed on and simulated forward again.
+//
+// Every tick sends the local inputs the peer hasn't acknowledged yet, so lost packets are covered by the
+// next one. Packets also carry a checksum of the latest frame both peers agree on to catch desyncs.
+class RollbackSession
+{
+public:
+	// Frames live in rings of this many entries, maxRollback + inputDelay has to stay below it
+	static constexpr int window = 64;
+	static constexpr int playerCount = 2;
+
+	RollbackSession(GameEngine* game, Scene_PlayLevel& scene, Transport& transport, int localPlayer, const RollbackSettings& settings);
+
+	// Local player input, player movement is synchronized, everything else is ignored
+	void perform(const Command& command);
+	// Simulates the next frame, re-simulating mispredicted ones first. False when waiting for the remote player.
+	bool advance();
+
+	// Next frame to be simulated
+	int getFrame() const { return frame; }
+	// Last frame for which both players' inputs are known
+	int getConfirmedFrame() const;
+	const RollbackStats& getStats() const { return stats; }
+
+private:
+	enum Button : uint8_t
+	{
+		Left = 1,
+		Right = 2,
+		Up = 4,
+		Fire = 8,
+	};
+
+	struct FrameInput
+	{
+		int frame = -1;
+		uint8_t buttons = 0;
+		bool confirmed = false;
+	};
+
+	FrameInput& input(int player, int frame) { return inputs[player][frame % window]; }
+	uint8_t inputFor(int player, int frame);
+	void receive();
+	void send();
+	void rollback(int from);
+	void simulate(int frame);
+	void updateChecksums();
+	void compareChecksum(int frame, uint64_t checksum);
+
+	GameEngine* game;
+	Scene_PlayLevel& scene;
+	Transport& transport;
+	int localPlayer;
+	int remotePlayer;
+	RollbackSettings settings;
+	RollbackStats stats;
+
+	bool started = false;
+	int frame = 0;
+	uint8_t localButtons = 0;
+	std::array<std::array<FrameInput, window>, playerCount> inputs;
+	int remoteConfirmed = -1; // every remote input up to here arrived
+	int remoteAcknowledged = -1; // every local input up to here arrived at the peer
+	int mispredicted = INT32_MAX; // earliest frame simulated with a wrong prediction
+
+	// State at the start of each frame
+	std::vector<LevelSnapshot> states;
+	// Checksums of the state at the start of each frame, final up to checksumFrame
+	std::array<uint64_t, window> checksums = {};
+	int checksumFrame = -1;
+	int remoteChecksumFrame = -1; // latest checksum from the peer, -1 once compared
+	uint64_t remoteChecksum = 0;
+	int comparedFrame = -1;
+
+	std::vector<uint8_t> packet;
+};
@@ -1,12 +1,15 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <memory>
 
 #include "entities.h"
 #include "commands.h"
+#include "renderer.h"
 
 class GameEngine;
+struct AssetChange;
 
 class Scene
 {
@@ -17,7 +20,16 @@ public:
 	virtual void enter() = 0;
 	virtual void leave() = 0;
 	virtual void perform(const Command& action) = 0;
+	// Advances the simulation, runs on the simulation thread
 	virtual void tick() = 0;
+	// Describes the current state for the render thread, runs on the simulation thread after tick()
+	virtual void render(RenderSnapshot& snapshot) = 0;
+	// An asset was reloaded from disk, runs on the simulation thread between ticks
+	virtual void assetChanged(const AssetChange&) {}
+	// False while the scene waits for something before it can be played, ticks don't change anything then
+	virtual bool ready() { return true; }
+	// Hash of the simulation state, equal for equal states. Used to check that replays stay in sync.
+	virtual uint64_t checksum() { return 0; }
 protected:
 	GameEngine* game;
 	Entities entities;
@@ -0,0 +1,163 @@
+#include "levelformat.h"
+#include "levelstream.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	class LevelWriter
+	{
+	public:
+		uint32_t addString(const std::string& text) {
+			auto known = stringIds.find(text);
+			if (known != stringIds.end()) {
+				return known->second;
+			}
+			CompiledString record;
+			record.offset = (uint32_t)stringData.size();
+			record.length = (uint32_t)text.size();
+			stringData.insert(stringData.end(), text.begin(), text.end());
+			strings.push_back(record);
+			return stringIds[text] = (uint32_t)strings.size() - 1;
+		}
+
+		uint32_t addPrefab(LevelObject::Type type, uint32_t animation) {
+			auto key = std::make_pair((uint32_t)type, animation);
+			auto known = prefabIds.find(key);
+			if (known != prefabIds.end()) {
+				return known->second;
+			}
+			prefabs.push_back(CompiledPrefab{ key.first, key.second });
+			return prefabIds[key] = (uint32_t)prefabs.size() - 1;
+		}
+
+		template<typename T>
+		void write(std::ofstream& file, const std::vector<T>& records) {
+			file.write((const char*)records.data(), records.size() * sizeof(T));
+		}
+
+		std::vector<CompiledString> strings;
+		std::vector<char> stringData;
+		std::vector<CompiledPrefab> prefabs;
+
+	private:
+		std::unordered_map<std::string, uint32_t> stringIds;
+		std::map<std::pair<uint32_t, uint32_t>, uint32_t> prefabIds;
+	};
+
+	int32_t cell(float position) {
+		if (position != floorf(position)) {
+			throw std::runtime_error("Only objects on whole grid cells can be compiled");
+		}
+		return (int32_t)position;
+	}
+}
+
+void compileLevel(const std::string& textPath, const std::string& outputPath, int chunkSize) {
+	LevelStream level;
+	level.open(textPath, chunkSize);
+	if (level.isCompiled()) {
+		throw std::runtime_error("Level " + textPath + " is already compiled");
+	}
+
+	LevelWriter writer;
+	std::vector<uint32_t> animationIds;
+	for (auto& name : level.getAnimations()) {
+		animationIds.push_back(writer.addString(name));
+	}
+
+	std::vector<CompiledPlayer> players;
+	for (auto& object : level.getPlayers()) {
+		CompiledPlayer record = {};
+		record.gridX = object.grid.x;
+		record.gridY = object.grid.y;
+		record.boxX = object.boundingBox.position.x;
+		record.boxY = object.boundingBox.position.y;
+		record.boxWidth = object.boundingBox.size.x;
+		record.boxHeight = object.boundingBox.size.y;
+		record.movementSpeed = object.player.movementSpeed;
+		record.maxSpeed = object.player.maxSpeed;
+		record.jumpVelocity = object.player.jumpVelocity;
+		record.gravity = object.player.gravity;
+		record.bulletAnimation = writer.addString(object.player.bulletAnimation);
+		players.push_back(record);
+	}
+
+	// getChunks() is sorted by (y, x) already, which is the order the chunk table is searched in
+	std::vector<CompiledChunk> chunks;
+	std::vector<CompiledRun> runs;
+	size_t objectCount = 0;
+	for (auto key : level.getChunks()) {
+		std::vector<CompiledRun> cells;
+		for (auto& object : level.load(key)) {
+			cells.push_back(CompiledRun{ cell(object.grid.x), cell(object.grid.y), 1, writer.addPrefab(object.type, animationIds[object.animation]) });
+		}
+		std::sort(cells.begin(), cells.end(), [](const CompiledRun& left, const CompiledRun& right) {
+			return std::tie(left.prefab, left.y, left.x) < std::tie(right.prefab, right.y, right.x);
+		});
+
+		CompiledChunk chunk = { key.x, key.y, (uint32_t)runs.size(), 0 };
+		for (auto& object : cells) {
+			// Objects stacked on the same cell don't extend a run, they start a new one
+			if (chunk.runCount > 0) {
+				auto& last = runs.back();
+				if (last.prefab == object.prefab && last.y == object.y && last.x + (int32_t)last.length == object.x) {
+					last.length++;
+					continue;
+				}
+			}
+			runs.push_back(object);
+			chunk.runCount++;
+		}
+		objectCount += cells.size();
+		chunks.push_back(chunk);
+	}
+
+	CompiledLevelHeader header = {};
+	header.magic = levelMagic;
+	header.version = levelVersion;
+	header.chunkSize = (uint32_t)level.getChunkSize();
+	header.stringCount = (uint32_t)writer.strings.size();
+	header.prefabCount = (uint32_t)writer.prefabs.size();
+	header.playerCount = (uint32_t)players.size();
+	header.chunkCount = (uint32_t)chunks.size();
+	header.runCount = (uint32_t)runs.size();
+	header.stringDataOffset = sizeof(CompiledLevelHeader)
+		+ writer.strings.size() * sizeof(CompiledString)
+		+ writer.prefabs.size() * sizeof(CompiledPrefab)
+		+ players.size() * sizeof(CompiledPlayer)
+		+ chunks.size() * sizeof(CompiledChunk)
+		+ runs.size() * sizeof(CompiledRun);
+	header.stringDataSize = writer.stringData.size();
+
+	// Written next to the output and moved over it once complete. A running game keeps the old file mapped,
+	// truncating it in place would pull the pages out from under the streaming thread.
+	std::string temporaryPath = outputPath + ".tmp";
+	std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to create " + temporaryPath);
+	}
+	file.write((const char*)&header, sizeof(header));
+	writer.write(file, writer.strings);
+	writer.write(file, writer.prefabs);
+	writer.write(file, players);
+	writer.write(file, chunks);
+	writer.write(file, runs);
+	writer.write(file, writer.stringData);
+	size_t size = (size_t)file.tellp();
+	file.close();
+	if (!file) {
+		throw std::runtime_error("Failed to write " + temporaryPath);
+	}
+	std::filesystem::rename(temporaryPath, outputPath);
+	std::cout << "Compiled level " << std::quoted(outputPath) << ": " << objectCount << " objects as " << runs.size() << " runs of "
+		<< writer.prefabs.size() << " prefabs in " << chunks.size() << " chunks, " << size << " bytes" << std::endl;
+}
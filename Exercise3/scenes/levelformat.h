@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// Compiled level, written by compileLevel() and memory mapped by LevelStream.
+// Layout: CompiledLevelHeader, then the string, prefab, player, chunk and run tables back to back, then the string data.
+// Chunks are sorted by (y, x), runs are grouped per chunk and within a chunk by prefab and row.
+
+constexpr uint32_t levelMagic = 0x4C564C33; // "3LVL" read as little endian
+constexpr uint32_t levelVersion = 1;
+
+struct CompiledLevelHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t chunkSize;
+	uint32_t stringCount;
+	uint32_t prefabCount;
+	uint32_t playerCount;
+	uint32_t chunkCount;
+	uint32_t runCount;
+	uint64_t stringDataOffset; // from the start of the file
+	uint64_t stringDataSize;
+};
+
+struct CompiledString
+{
+	uint32_t offset; // into the string data
+	uint32_t length;
+};
+
+// Every distinct combination of object type and animation
+struct CompiledPrefab
+{
+	uint32_t type; // LevelObject::Type
+	uint32_t animation; // string index
+};
+
+struct CompiledPlayer
+{
+	float gridX;
+	float gridY;
+	float boxX;
+	float boxY;
+	float boxWidth;
+	float boxHeight;
+	float movementSpeed;
+	float maxSpeed;
+	float jumpVelocity;
+	float gravity;
+	uint32_t bulletAnimation; // string index
+	uint32_t reserved;
+};
+
+struct CompiledChunk
+{
+	int32_t x;
+	int32_t y;
+	uint32_t firstRun;
+	uint32_t runCount;
+};
+
+// length instances of a prefab in consecutive cells of one row
+struct CompiledRun
+{
+	int32_t x;
+	int32_t y;
+	uint32_t length;
+	uint32_t prefab;
+};
+
+// Tables are read in place from the mapping, so every record has to keep them 8 byte aligned
+template<typename T>
+constexpr bool isCompiledLevelRecord = std::is_trivially_copyable_v<T> && sizeof(T) % 8 == 0;
+static_assert(isCompiledLevelRecord<CompiledLevelHeader> && isCompiledLevelRecord<CompiledString> && isCompiledLevelRecord<CompiledPrefab>, "Invalid level record layout");
+static_assert(isCompiledLevelRecord<CompiledPlayer> && isCompiledLevelRecord<CompiledChunk> && isCompiledLevelRecord<CompiledRun>, "Invalid level record layout");
+
+// Compiles a text level into the binary format, objects have to be on whole cells
+void compileLevel(const std::string& textPath, const std::string& outputPath, int chunkSize);
@@ -0,0 +1,380 @@
+#include "levelstream.h"
+#include "levelformat.h"
+#include "../parser.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <tuple>
+
+// Parsers filling in the given object, one per instruction of the level format.
+// Tile and dec animations are left in animationName for the caller to look up.
+static parser_map levelParsers(LevelObject& object, std::string& animationName) {
+	parser_map parsers;
+	parsers["Player"] = [&](auto instruction, auto& stream) {
+		object = LevelObject();
+		object.type = LevelObject::Type::Player;
+		auto& box = object.boundingBox;
+		auto& player = object.player;
+		if (!(stream
+			>> object.grid.x
+			>> object.grid.y
+			>> box.position.x
+			>> box.position.y
+			>> box.size.x
+			>> box.size.y
+			>> player.movementSpeed
+			>> player.maxSpeed
+			>> player.jumpVelocity
+			>> player.gravity
+			>> player.bulletAnimation
+			)) {
+			throw stream.error("Level included faulty player config");
+		}
+	};
+	parsers["Tile"] = [&](auto instruction, auto& stream) {
+		object = LevelObject();
+		object.type = LevelObject::Type::Tile;
+		if (!(stream
+			>> object.grid.x
+			>> object.grid.y
+			>> animationName
+			)) {
+			throw stream.error("Level included faulty tile config");
+		}
+	};
+	parsers["Dec"] = [&](auto instruction, auto& stream) {
+		object = LevelObject();
+		object.type = LevelObject::Type::Dec;
+		if (!(stream
+			>> object.grid.x
+			>> object.grid.y
+			>> animationName
+			)) {
+			throw stream.error("Level included faulty dec config");
+		}
+	};
+	return parsers;
+}
+
+static const parser_function unknownInstruction = [](std::string_view instruction, ParserLine& line) {
+	throw line.error("Unknown instruction type '" + std::string(instruction) + "'");
+};
+
+LevelStream::~LevelStream() {
+	close();
+}
+
+void LevelStream::open(const std::string& levelPath, int size) {
+	close();
+	path = levelPath;
+	chunkSize = size;
+	players.clear();
+	animations.clear();
+	bounds = vec2::zero();
+	text.clear();
+	index.clear();
+	animationIds.clear();
+	compiled = MappedFile();
+	compiledChunks = nullptr;
+	compiledChunkCount = 0;
+	compiledRuns = nullptr;
+	prefabTypes.clear();
+	prefabAnimations.clear();
+
+	std::error_code error;
+	modified = std::filesystem::last_write_time(path, error);
+	uint32_t magic = 0;
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open level file");
+	}
+	file.read((char*)&magic, sizeof(magic));
+	file.close();
+	if (magic == levelMagic) {
+		openCompiled();
+	} else {
+		openText();
+	}
+
+	stopping = false;
+	worker = std::thread(&LevelStream::work, this);
+}
+
+void LevelStream::openText() {
+	// The text is kept in memory, chunks are parsed from it on demand
+	text = read_text_file(path);
+
+	// One pass over the text, remembering where the objects of each chunk are
+	LevelObject object;
+	std::string animationName;
+	auto parsers = levelParsers(object, animationName);
+	ParserText lines(text, path);
+	ParserLine line;
+	size_t objectCount = 0;
+	while (lines.next(line)) {
+		auto location = line.getLocation();
+		if (!generic_parse_line(line, parsers, unknownInstruction)) {
+			continue;
+		}
+		if (object.type == LevelObject::Type::Player) {
+			players.push_back(object);
+		} else {
+			// Animation names are interned up front so load() only has to read the table
+			if (animationIds.emplace(animationName, (uint32_t)animations.size()).second) {
+				animations.push_back(animationName);
+			}
+			index[chunkAt(object.grid)].push_back(location);
+			bounds.x = fmaxf(bounds.x, object.grid.x);
+			bounds.y = fmaxf(bounds.y, object.grid.y);
+			objectCount++;
+		}
+	}
+	std::cout << "Indexed level " << std::quoted(path) << ": " << objectCount << " objects in " << index.size() << " chunks" << std::endl;
+}
+
+void LevelStream::openCompiled() {
+	compiled = MappedFile(path);
+	const uint8_t* data = compiled.data();
+	auto corrupt = [&] {
+		return std::runtime_error("Level " + path + " is corrupt or from another version");
+	};
+	if (compiled.size() < sizeof(CompiledLevelHeader)) {
+		throw corrupt();
+	}
+	auto& header = *(const CompiledLevelHeader*)data;
+	uint64_t tablesSize = sizeof(CompiledLevelHeader)
+		+ (uint64_t)header.stringCount * sizeof(CompiledString)
+		+ (uint64_t)header.prefabCount * sizeof(CompiledPrefab)
+		+ (uint64_t)header.playerCount * sizeof(CompiledPlayer)
+		+ (uint64_t)header.chunkCount * sizeof(CompiledChunk)
+		+ (uint64_t)header.runCount * sizeof(CompiledRun);
+	if (header.version != levelVersion || header.chunkSize == 0 || tablesSize > header.stringDataOffset
+		|| header.stringDataOffset > compiled.size() || header.stringDataSize > compiled.size() - header.stringDataOffset) {
+		throw corrupt();
+	}
+	chunkSize = (int)header.chunkSize;
+
+	auto strings = (const CompiledString*)(data + sizeof(CompiledLevelHeader));
+	auto prefabs = (const CompiledPrefab*)(strings + header.stringCount);
+	auto compiledPlayers = (const CompiledPlayer*)(prefabs + header.prefabCount);
+	compiledChunks = (const CompiledChunk*)(compiledPlayers + header.playerCount);
+	compiledChunkCount = header.chunkCount;
+	compiledRuns = (const CompiledRun*)(compiledChunks + header.chunkCount);
+
+	const char* stringData = (const char*)data + header.stringDataOffset;
+	for (uint32_t i = 0; i < header.stringCount; i++) {
+		if (strings[i].offset > header.stringDataSize || strings[i].length > header.stringDataSize - strings[i].offset) {
+			throw corrupt();
+		}
+		animations.emplace_back(stringData + strings[i].offset, strings[i].length);
+	}
+	for (uint32_t i = 0; i < header.prefabCount; i++) {
+		if (prefabs[i].type > (uint32_t)LevelObject::Type::Dec || prefabs[i].animation >= header.stringCount) {
+			throw corrupt();
+		}
+		prefabTypes.push_back((LevelObject::Type)prefabs[i].type);
+		prefabAnimations.push_back(prefabs[i].animation);
+	}
+	for (uint32_t i = 0; i < header.playerCount; i++) {
+		auto& record = compiledPlayers[i];
+		if (record.bulletAnimation >= header.stringCount) {
+			throw corrupt();
+		}
+		LevelObject object;
+		object.type = LevelObject::Type::Player;
+		object.grid = vec2(record.gridX, record.gridY);
+		object.boundingBox.position = vec2(record.boxX, record.boxY);
+		object.boundingBox.size = vec2(record.boxWidth, record.boxHeight);
+		object.player.movementSpeed = record.movementSpeed;
+		object.player.maxSpeed = record.maxSpeed;
+		object.player.jumpVelocity = record.jumpVelocity;
+		object.player.gravity = record.gravity;
+		object.player.bulletAnimation = animations[record.bulletAnimation];
+		players.push_back(object);
+	}
+
+	// Only the run bounds are checked here, load() trusts them afterwards
+	size_t objectCount = 0;
+	for (uint32_t i = 0; i < header.chunkCount; i++) {
+		auto& chunk = compiledChunks[i];
+		if (chunk.firstRun > header.runCount || chunk.runCount > header.runCount - chunk.firstRun) {
+			throw corrupt();
+		}
+		for (uint32_t j = chunk.firstRun; j < chunk.firstRun + chunk.runCount; j++) {
+			auto& run = compiledRuns[j];
+			if (run.prefab >= header.prefabCount || run.length == 0) {
+				throw corrupt();
+			}
+			bounds.x = fmaxf(bounds.x, (float)(run.x + (int32_t)run.length - 1));
+			bounds.y = fmaxf(bounds.y, (float)run.y);
+			objectCount += run.length;
+		}
+	}
+	std::cout << "Mapped compiled level " << std::quoted(path) << ": " << objectCount << " objects in " << compiledChunkCount << " chunks" << std::endl;
+}
+
+void LevelStream::close() {
+	if (worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		worker.join();
+	}
+	requests.clear();
+	results.clear();
+}
+
+bool LevelStream::isUpToDate(const std::string& levelPath) const {
+	std::error_code error;
+	return worker.joinable() && levelPath == path && std::filesystem::last_write_time(path, error) == modified && !error;
+}
+
+ChunkKey LevelStream::chunkAt(const vec2& grid) const {
+	ChunkKey key;
+	key.x = (int)floorf(grid.x / chunkSize);
+	key.y = (int)floorf(grid.y / chunkSize);
+	return key;
+}
+
+std::vector<ChunkKey> LevelStream::chunksAround(ChunkKey center, int radius) const {
+	std::vector<ChunkKey> chunks;
+	for (int y = center.y - radius; y <= center.y + radius; y++) {
+		for (int x = center.x - radius; x <= center.x + radius; x++) {
+			ChunkKey key{ x, y };
+			if (hasChunk(key)) {
+				chunks.push_back(key);
+			}
+		}
+	}
+	return chunks;
+}
+
+std::vector<ChunkKey> LevelStream::getChunks() const {
+	std::vector<ChunkKey> chunks;
+	if (isCompiled()) {
+		for (uint32_t i = 0; i < compiledChunkCount; i++) {
+			chunks.push_back(ChunkKey{ compiledChunks[i].x, compiledChunks[i].y });
+		}
+	} else {
+		for (auto& chunk : index) {
+			chunks.push_back(chunk.first);
+		}
+		std::sort(chunks.begin(), chunks.end(), [](const ChunkKey& left, const ChunkKey& right) {
+			return std::tie(left.y, left.x) < std::tie(right.y, right.x);
+		});
+	}
+	return chunks;
+}
+
+bool LevelStream::hasChunk(ChunkKey key) const {
+	return isCompiled() ? findCompiledChunk(key) != nullptr : index.find(key) != index.end();
+}
+
+const CompiledChunk* LevelStream::findCompiledChunk(ChunkKey key) const {
+	// The chunk table is sorted by (y, x)
+	auto end = compiledChunks + compiledChunkCount;
+	auto chunk = std::lower_bound(compiledChunks, end, key, [](const CompiledChunk& chunk, const ChunkKey& key) {
+		return std::tie(chunk.y, chunk.x) < std::tie(key.y, key.x);
+	});
+	if (chunk == end || chunk->x != key.x || chunk->y != key.y) {
+		return nullptr;
+	}
+	return chunk;
+}
+
+void LevelStream::request(ChunkKey key) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requests.push_back(key);
+	}
+	wake.notify_one();
+}
+
+bool LevelStream::poll(ChunkKey& key, std::vector<LevelObject>& objects) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (results.empty()) {
+		return false;
+	}
+	key = results.front().first;
+	objects = std::move(results.front().second);
+	results.pop_front();
+	return true;
+}
+
+std::vector<LevelObject> LevelStream::load(ChunkKey key) const {
+	std::vector<LevelObject> objects;
+	if (isCompiled()) {
+		// No parsing, the runs are expanded straight from the mapping
+		auto chunk = findCompiledChunk(key);
+		if (!chunk) {
+			return objects;
+		}
+		auto runs = compiledRuns + chunk->firstRun;
+		size_t count = 0;
+		for (uint32_t i = 0; i < chunk->runCount; i++) {
+			count += runs[i].length;
+		}
+		objects.reserve(count);
+		for (uint32_t i = 0; i < chunk->runCount; i++) {
+			LevelObject object;
+			object.type = prefabTypes[runs[i].prefab];
+			object.animation = prefabAnimations[runs[i].prefab];
+			object.grid.y = (float)runs[i].y;
+			for (uint32_t x = 0; x < runs[i].length; x++) {
+				object.grid.x = (float)(runs[i].x + (int32_t)x);
+				objects.push_back(object);
+			}
+		}
+		return objects;
+	}
+
+	auto chunk = index.find(key);
+	if (chunk == index.end()) {
+		return objects;
+	}
+
+	LevelObject object;
+	std::string animationName;
+	auto parsers = levelParsers(object, animationName);
+	ParserLine line;
+	objects.reserve(chunk->second.size());
+	for (auto location : chunk->second) {
+		ParserText lines(text, path, location);
+		if (lines.next(line) && generic_parse_line(line, parsers, unknownInstruction)) {
+			object.animation = animationIds.at(animationName);
+			objects.push_back(object);
+		}
+	}
+	return objects;
+}
+
+void LevelStream::work() {
+	while (true) {
+		ChunkKey key;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !requests.empty(); });
+			if (stopping) {
+				return;
+			}
+			key = requests.front();
+			requests.pop_front();
+		}
+
+		std::vector<LevelObject> objects;
+		try {
+			objects = load(key);
+		} catch (const std::exception& error) {
+			// Chunks were checked when the level was opened, but one bad chunk shouldn't take the game down
+			std::cout << "Failed to stream chunk (" << key.x << ", " << key.y << "): " << error.what() << std::endl;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		results.emplace_back(key, std::move(objects));
+	}
+}
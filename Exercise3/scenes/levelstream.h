@@ -0,0 +1,146 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../geometry.h"
+#include "../mappedfile.h"
+#include "../parser.h"
+
+struct PlayerConfig
+{
+	float movementSpeed = 0;
+	float jumpVelocity = 0;
+	float maxSpeed = 0;
+	float gravity = 0;
+	std::string bulletAnimation;
+};
+
+inline bool operator==(const PlayerConfig& left, const PlayerConfig& right) {
+	return left.movementSpeed == right.movementSpeed
+		&& left.jumpVelocity == right.jumpVelocity
+		&& left.maxSpeed == right.maxSpeed
+		&& left.gravity == right.gravity
+		&& left.bulletAnimation == right.bulletAnimation;
+}
+
+// One line of a level file
+struct LevelObject
+{
+	enum class Type
+	{
+		Player,
+		Tile,
+		Dec,
+	};
+
+	Type type = Type::Tile;
+	vec2 grid;
+	uint32_t animation = 0; // Tile and Dec: index into LevelStream::getAnimations()
+	rect boundingBox; // Player
+	PlayerConfig player; // Player
+};
+
+// Square block of chunkSize x chunkSize grid cells
+struct ChunkKey
+{
+	int x = 0;
+	int y = 0;
+
+	bool operator==(const ChunkKey& other) const { return x == other.x && y == other.y; }
+	bool operator!=(const ChunkKey& other) const { return !(*this == other); }
+};
+
+struct ChunkKeyHash
+{
+	size_t operator()(const ChunkKey& key) const {
+		return std::hash<int64_t>()(((int64_t)key.x << 32) ^ (uint32_t)key.y);
+	}
+};
+
+struct CompiledChunk;
+struct CompiledRun;
+
+// Index of a level by chunk, the objects of a chunk are read on a background thread when it's requested.
+// Text levels are kept in memory with the position of every object, the objects are parsed when their
+// chunk is loaded. Compiled levels (see levelformat.h) are memory mapped and their tables used in place.
+class LevelStream
+{
+public:
+	LevelStream() = default;
+	~LevelStream();
+
+	LevelStream(const LevelStream&) = delete;
+	LevelStream& operator=(const LevelStream&) = delete;
+
+	// Indexes the level file and starts the loading thread, throws when the file is faulty.
+	// Compiled levels are recognized by their header and use the chunk size they were compiled with.
+	void open(const std::string& path, int chunkSize);
+	// Stops the loading thread, pending requests are dropped
+	void close();
+	// True when this file is open and hasn't been written since
+	bool isUpToDate(const std::string& path) const;
+
+	// Players aren't streamed, they are kept in memory for the whole level
+	const std::vector<LevelObject>& getPlayers() const { return players; }
+	// Largest grid position of any tile or decoration
+	vec2 getBounds() const { return bounds; }
+	// Animation names used by the level
+	const std::vector<std::string>& getAnimations() const { return animations; }
+	int getChunkSize() const { return chunkSize; }
+	bool isCompiled() const { return compiled.isOpen(); }
+	ChunkKey chunkAt(const vec2& grid) const;
+	// Every chunk with at least one object
+	std::vector<ChunkKey> getChunks() const;
+	// Chunks that contain at least one object and lie within radius chunks of center
+	std::vector<ChunkKey> chunksAround(ChunkKey center, int radius) const;
+
+	// Queues a chunk for loading on the background thread
+	void request(ChunkKey key);
+	// Hands out one loaded chunk, returns false when none is ready
+	bool poll(ChunkKey& key, std::vector<LevelObject>& objects);
+	// Loads a chunk on the calling thread
+	std::vector<LevelObject> load(ChunkKey key) const;
+
+private:
+	void openText();
+	void openCompiled();
+	bool hasChunk(ChunkKey key) const;
+	const CompiledChunk* findCompiledChunk(ChunkKey key) const;
+	void work();
+
+	std::string path;
+	std::filesystem::file_time_type modified;
+	int chunkSize = 16;
+	std::vector<LevelObject> players;
+	std::vector<std::string> animations;
+	vec2 bounds;
+
+	// Text levels
+	std::string text;
+	std::unordered_map<ChunkKey, std::vector<ParserLocation>, ChunkKeyHash> index;
+	std::unordered_map<std::string, uint32_t> animationIds;
+
+	// Compiled levels
+	MappedFile compiled;
+	const CompiledChunk* compiledChunks = nullptr;
+	uint32_t compiledChunkCount = 0;
+	const CompiledRun* compiledRuns = nullptr;
+	std::vector<LevelObject::Type> prefabTypes;
+	std::vector<uint32_t> prefabAnimations;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+	std::deque<ChunkKey> requests;
+	std::deque<std::pair<ChunkKey, std::vector<LevelObject>>> results;
+};
@@ -6,24 +6,21 @@ void Scene_MainMenu::enter() {
 
 	float y = 60;
 	float spacing = 20;
-	int windowWidth = game->getWindow().getSize().x;
+	float centerX = game->getViewSize().x / 2;
 
 	auto& assets = game->getAssets();
-	auto& font = assets.getFont("Mario");
+	font = &assets.getFont("Mario");
 
+	// Labels are measured and centered by the renderer, fonts must only be touched on the render thread
 	options.clear();
 	auto& names = assets.getLevelNames();
 	options.reserve(names.size());
 	for (auto& levelName : names) {
 		MenuItem item;
 		item.name = levelName;
-		auto& label = item.label;
-		label.setString(levelName);
-		label.setFont(font);
-		auto bounds = label.getLocalBounds();
-		label.setPosition(vec2((windowWidth - bounds.width) / 2, y));
+		item.position = vec2(centerX, y);
 		options.push_back(item);
-		y += bounds.height + spacing;
+		y += characterSize + spacing;
 	}
 }
 
@@ -32,7 +29,10 @@ void Scene_MainMenu::leave() {
 }
 
 void Scene_MainMenu::tick() {
-	sysRender();
+}
+
+void Scene_MainMenu::render(RenderSnapshot& snapshot) {
+	sysRender(snapshot);
 }
 
 void Scene_MainMenu::perform(const Command& action) {
@@ -64,20 +64,22 @@ void Scene_MainMenu::perform(const Command& action) {
 	}
 }
 
-void Scene_MainMenu::sysRender() {
-	auto& window = game->getWindow();
-	window.clear();
+void Scene_MainMenu::sysRender(RenderSnapshot& snapshot) {
 	for (auto it = options.begin(); it != options.end(); ++it) {
 		auto index = std::distance(options.begin(), it);
-		auto& label = it->label;
 
+		TextInstance label;
+		label.font = font;
+		label.text = it->name;
+		label.characterSize = characterSize;
+		label.position = it->position;
+		label.centered = true;
 		if (index == selected) {
-			label.setFillColor(sf::Color::Red);
+			label.color = sf::Color::Red;
 		} else {
-			label.setFillColor(sf::Color::White);
+			label.color = sf::Color::White;
 		}
 
-		window.draw(label);
+		snapshot.texts.push_back(label);
 	}
-	window.display();
 }
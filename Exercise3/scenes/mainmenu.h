@@ -5,7 +5,7 @@
 struct MenuItem
 {
 	std::string name;
-	sf::Text label;
+	vec2 position;
 };
 
 class Scene_MainMenu : public Scene
@@ -17,10 +17,13 @@ public:
 	void leave();
 	void perform(const Command& action);
 	void tick();
+	void render(RenderSnapshot& snapshot);
 
 private:
-	void sysRender();
+	void sysRender(RenderSnapshot& snapshot);
 
 	std::vector<MenuItem> options;
 	size_t selected = 0;
+	const sf::Font* font = nullptr;
+	unsigned int characterSize = 30;
 };
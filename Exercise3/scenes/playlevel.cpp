@@ -1,20 +1,54 @@
 #include "playlevel.h"
 #include "../engine.h"
-#include "../parser.h"
+#include "../allocations.h"
 #include "../geometry.h"
+#include "../profiler.h"
+#include "../radixsort.h"
+#include "../staterecording.h"
 #include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
 #include <deque>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+Scene_PlayLevel::Scene_PlayLevel(GameEngine* game)
+	: Scene(game)
+	, textureRefs(game->getAssets())
+	, history((size_t)(game->getSettings().rewindSeconds * game->getSettings().tickRate)) {
+}
 
 void Scene_PlayLevel::enter() {
 	frame = 0;
+	time = 0;
+	loopFrames.clear();
 	paused = false;
 	drawTextures = true;
-	drawBoxes = false;
+	drawBoxes = DebugBoxMode::Off;
 	drawGrid = false;
+	drawPerf = false;
+	Profiler::setEnabled(!game->getSettings().profilePath.empty());
+	rewinding = false;
 }
 
 void Scene_PlayLevel::leave() {
+	game->stopMusic();
+	// The level stream and its image are kept, coming back to the same level starts from them
+	loadedChunks.clear();
+	requestedChunks.clear();
+	objectStates.clear();
+	players = LoadedChunk();
 	entities = Entities();
+	textureRefs.clear();
+	drawList.clear();
+	drawListGeneration = UINT64_MAX;
+	clearSnapshots();
 }
 
 void Scene_PlayLevel::perform(const Command& action) {
@@ -24,6 +58,33 @@ void Scene_PlayLevel::perform(const Command& action) {
 				paused = !paused;
 			}
 			break;
+		case Command::Restart:
+			if (!action.ended) {
+				resetLevel();
+				paused = false;
+			}
+			break;
+		case Command::SaveState:
+			if (!action.ended) {
+				auto start = std::chrono::steady_clock::now();
+				saveState(savedState);
+				auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+				std::cout << "Saved frame " << savedState.frame << " (" << savedState.data.size() << " bytes) in " << elapsed.count() << "us" << std::endl;
+			}
+			break;
+		case Command::LoadState:
+			if (!action.ended && !savedState.data.empty()) {
+				auto start = std::chrono::steady_clock::now();
+				loadState(savedState);
+				auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+				std::cout << "Loaded frame " << savedState.frame << " in " << elapsed.count() << "us" << std::endl;
+				// What came after the loaded frame didn't happen
+				history.clear();
+			}
+			break;
+		case Command::Rewind:
+			rewinding = !action.ended;
+			break;
 		case Command::DebugTextures:
 			if (!action.ended) {
 				drawTextures = !drawTextures;
@@ -31,7 +92,13 @@ void Scene_PlayLevel::perform(const Command& action) {
 			break;
 		case Command::DebugBoxes:
 			if (!action.ended) {
-				drawBoxes = !drawBoxes;
+				// Cycle through the coloring modes before switching off again
+				switch (drawBoxes) {
+					case DebugBoxMode::Off: drawBoxes = DebugBoxMode::Plain; break;
+					case DebugBoxMode::Plain: drawBoxes = DebugBoxMode::ByTag; break;
+					case DebugBoxMode::ByTag: drawBoxes = DebugBoxMode::ByCell; break;
+					case DebugBoxMode::ByCell: drawBoxes = DebugBoxMode::Off; break;
+				}
 			}
 			break;
 		case Command::DebugGrid:
@@ -39,16 +106,24 @@ void Scene_PlayLevel::perform(const Command& action) {
 				drawGrid = !drawGrid;
 			}
 			break;
+		case Command::DebugPerf:
+			if (!action.ended) {
+				drawPerf = !drawPerf;
+				Profiler::setEnabled(drawPerf || !game->getSettings().profilePath.empty());
+			}
+			break;
 
 		case Command::Left:
 		case Command::Right:
 		case Command::Up:
 		case Command::Fire:
 		{
-			for (auto& entity : entities.list(Entity::Tag::Player)) {
+			if (action.player >= players.entities.size()) {
+				break;
+			}
+			auto& entity = players.entities[action.player];
+			if (entity && entity->alive()) {
 				auto& input = entity->getComponent<CInput>();
-				auto& state = entity->getComponent<CPlayerState>();
-
 				switch (action.type) {
 					case Command::Left: input.left = !action.ended; break;
 					case Command::Right: input.right = !action.ended; break;
@@ -62,17 +137,39 @@ void Scene_PlayLevel::perform(const Command& action) {
 }
 
 void Scene_PlayLevel::tick() {
+	ProfileZone zone("Scene_PlayLevel::tick", ProfileZone::Frame);
+	uint64_t allocations = threadAllocations();
+	timeStep = game->getTimeScale();
+	if (rewinding && !history.empty()) {
+		// Step back one tick, the oldest snapshot stays so rewinding stops there
+		loadState(history.recent(0));
+		if (history.size() > 1) {
+			history.dropRecent(1);
+		}
+		return;
+	}
 	sysEntities();
-	if (!paused) {
+	sysPreviousPosition();
+	// Only the initial load blocks, textures of chunks streamed in later just pop in
+	if (!paused && ready()) {
+		time += timeStep;
 		sysGravity();
 		sysInput();
 		sysMovement();
 		sysCollision();
 		sysAnimation();
+		sysCamera();
 	}
-	sysRender();
-	sysPreviousPosition();
+	sysStreaming();
 	frame++;
+	if (history.capacity() > 0) {
+		saveState(history.push());
+	}
+	tickAllocations = threadAllocations() - allocations;
+}
+
+void Scene_PlayLevel::render(RenderSnapshot& snapshot) {
+	sysRender(snapshot);
 }
 
 vec2 Scene_PlayLevel::gridToPixel(const vec2& gridPos) const {
@@ -89,94 +186,631 @@ void Scene_PlayLevel::setLevel(const LevelConfig& config) {
 }
 
 void Scene_PlayLevel::resetLevel() {
+	clearSnapshots();
 	entities.clear();
-	std::cout << "Loading level " << std::quoted(levelConfig.name) << " from " << std::quoted(levelConfig.path) << std::endl;
+	drawList.clear();
+	drawListGeneration = UINT64_MAX;
+	loadedChunks.clear();
+	requestedChunks.clear();
+	objectStates.clear();
+
+	auto& assets = game->getAssets();
+	levelAssets.stand = assets.findAnimation("Stand");
+	levelAssets.coinBox = assets.findAnimation("Question");
+	levelAssets.usedCoinBox = assets.findAnimation("Question2");
+	levelAssets.coin = assets.findAnimation("Coin");
+	levelAssets.gridFont = assets.findFont("Arial");
+	levelAssets.shootSound = assets.findSound("Shoot");
+	levelAssets.coinSound = assets.findSound("Coin");
+	levelAssets.breakSound = assets.findSound("Break");
+	levelAssets.music = assets.findMusic(levelConfig.name);
+	game->playMusic(levelAssets.music);
+
+	// Restarts spawn from the chunks parsed before, the file is only read again when it changed
+	if (levelStream->isUpToDate(levelConfig.path)) {
+		std::cout << "Restarting level " << std::quoted(levelConfig.name) << " from " << chunkImages.size() << " parsed chunks" << std::endl;
+	} else {
+		std::cout << "Loading level " << std::quoted(levelConfig.name) << " from " << std::quoted(levelConfig.path) << std::endl;
+		levelStream->open(levelConfig.path, game->getSettings().chunkSize);
+		levelAnimations = resolveAnimations(*levelStream);
+		chunkImages.clear();
+		playersImage = nullptr;
+	}
+	levelSize = levelStream->getBounds();
+	loadingTextures = true;
+	if (!playersImage) {
+		playersImage = buildImage(playerObjects());
+	}
+	instantiate(players, playersImage);
+	levelAssets.bullet = assets.findAnimation(playerConfig.bulletAnimation);
 
-	parser_map parsers;
+	// Chunks around the start are loaded right away so there is ground to stand on in the first tick
+	windowScroll = vec2::zero();
+	sysCamera();
+	previousWindowScroll = windowScroll;
+	startChunks.clear();
+	for (auto key : levelStream->chunksAround(cameraChunk(), game->getSettings().streamRadius)) {
+		startChunks.insert(key);
+		loadChunk(key, chunkImage(key));
+	}
+	retainTextures();
+}
+
+void Scene_PlayLevel::evictChunkImage(ChunkKey key) {
+	if (startChunks.find(key) == startChunks.end()) {
+		chunkImages.erase(key);
+	}
+}
+
+void Scene_PlayLevel::reloadLevel() {
+	// Everything that can fail is done before the scene changes: reading the file, looking up the
+	// animations it names and reading the chunks that are loaded
 	auto& assets = game->getAssets();
+	auto stream = std::make_unique<LevelStream>();
+	std::vector<AnimationHandle> animations;
+	std::unordered_map<ChunkKey, std::vector<LevelObject>, ChunkKeyHash> chunkObjects;
+	try {
+		stream->open(levelConfig.path, game->getSettings().chunkSize);
+		animations = resolveAnimations(*stream);
+		for (auto& player : stream->getPlayers()) {
+			assets.findAnimation(player.player.bulletAnimation);
+		}
+		for (auto& chunk : loadedChunks) {
+			chunkObjects[chunk.first] = stream->load(chunk.first);
+		}
+	} catch (const std::exception& error) {
+		// Most likely saved halfway through an edit, the previous level plays on until the next save
+		std::cout << "Failed to reload level, keeping the previous one: " << error.what() << std::endl;
+		return;
+	}
+	auto previousAnimations = std::move(levelAnimations);
+	levelAnimations = std::move(animations);
+	// Stops the previous stream's loading thread, its requests are dropped
+	levelStream = std::move(stream);
+	requestedChunks.clear();
+	chunkImages.clear();
+	clearSnapshots();
+
+	LevelDiff diff;
+	diffChunk(players, playerObjects(), previousAnimations, diff);
+	playersImage = players.image;
+	for (auto it = loadedChunks.begin(); it != loadedChunks.end(); ) {
+		diffChunk(it->second, std::move(chunkObjects[it->first]), previousAnimations, diff);
+		if (it->second.image->objects.empty()) {
+			it = loadedChunks.erase(it);
+		} else {
+			chunkImages[it->first] = it->second.image;
+			++it;
+		}
+	}
+
+	levelSize = levelStream->getBounds();
+	levelAssets.bullet = assets.findAnimation(playerConfig.bulletAnimation);
+	retainTextures();
+	std::cout << "Reloaded level " << std::quoted(levelConfig.name) << ": " << diff.added << " added, " << diff.changed << " changed, " << diff.removed << " removed" << std::endl;
+}
+
+std::vector<LevelObject> Scene_PlayLevel::playerObjects() const {
+	// Players the level doesn't place start next to the first one
+	auto objects = levelStream->getPlayers();
+	for (int i = 1; !objects.empty() && (int)objects.size() < game->getSettings().players; i++) {
+		auto player = objects.front();
+		player.grid.x += i;
+		objects.push_back(player);
+	}
+	return objects;
+}
+
+std::vector<AnimationHandle> Scene_PlayLevel::resolveAnimations(const LevelStream& stream) const {
+	// Level objects only carry an index into the level's own name table, names are looked up once here
+	auto& assets = game->getAssets();
+	std::vector<AnimationHandle> handles;
+	for (auto& name : stream.getAnimations()) {
+		handles.push_back(assets.findAnimation(name));
+	}
+	return handles;
+}
+
+void Scene_PlayLevel::diffChunk(LoadedChunk& chunk, std::vector<LevelObject> objects, const std::vector<AnimationHandle>& previousAnimations, LevelDiff& diff) {
+	// Match the new objects against the old ones by type and cell, unchanged objects keep their entity and its state
+	auto image = buildImage(std::move(objects));
+	auto& oldObjects = chunk.image->objects;
+	std::multimap<LevelObjectKey, size_t> previous;
+	for (size_t i = 0; i < oldObjects.size(); i++) {
+		previous.emplace(levelObjectKey(oldObjects[i]), i);
+	}
+
+	EntityList entitiesByObject;
+	entitiesByObject.reserve(image->objects.size());
+	for (size_t i = 0; i < image->objects.size(); i++) {
+		auto& object = image->objects[i];
+		auto match = previous.find(levelObjectKey(object));
+		if (match == previous.end()) {
+			entitiesByObject.push_back(instantiate(object, image->prototypes[i]));
+			diff.added++;
+			continue;
+		}
+
+		auto& oldObject = oldObjects[match->second];
+		auto entity = chunk.entities[match->second];
+		previous.erase(match);
+		// Animation indices differ between versions of the level file, so compare the clips they resolve to
+		bool unchanged = object.type == LevelObject::Type::Player
+			? object.player == oldObject.player
+				&& object.boundingBox.position == oldObject.boundingBox.position
+				&& object.boundingBox.size == oldObject.boundingBox.size
+			: levelAnimations[object.animation] == previousAnimations[oldObject.animation];
+		if (unchanged) {
+			entitiesByObject.push_back(entity);
+		} else if (object.type == LevelObject::Type::Player && entity && entity->alive()) {
+			// Don't teleport the player, only apply the new settings
+			playerConfig = object.player;
+			entity->getComponent<CBoundingBox>().box = object.boundingBox;
+			entitiesByObject.push_back(entity);
+			diff.changed++;
+		} else {
+			entities.remove(entity);
+			entitiesByObject.push_back(instantiate(object, image->prototypes[i]));
+			diff.changed++;
+		}
+	}
+	for (auto& leftover : previous) {
+		entities.remove(chunk.entities[leftover.second]);
+		diff.removed++;
+	}
+
+	chunk.image = std::move(image);
+	chunk.entities = std::move(entitiesByObject);
+}
+
+void Scene_PlayLevel::loadChunk(ChunkKey key, std::shared_ptr<const ChunkImage> image) {
+	instantiate(loadedChunks[key], std::move(image));
+}
+
+void Scene_PlayLevel::unloadChunk(LoadedChunk& chunk) {
+	// Remember what happened to the objects so it still applies when the chunk comes back
+	for (size_t i = 0; i < chunk.entities.size(); i++) {
+		auto& object = chunk.image->objects[i];
+		auto& entity = chunk.entities[i];
+		if (!entity || entity->dead()) {
+			objectStates[levelObjectKey(object)].destroyed = true;
+		} else if (levelAnimations[object.animation] == levelAssets.coinBox && !entity->hasComponent<CCoinBox>()) {
+			objectStates[levelObjectKey(object)].usedCoinBox = true;
+		}
+		entities.remove(entity);
+	}
+	chunk.image = nullptr;
+	chunk.entities.clear();
+}
+
+ChunkKey Scene_PlayLevel::cameraChunk() const {
+	return levelStream->chunkAt(pixelToGrid(windowScroll + game->getViewSize() / 2));
+}
+
+EntityPrototype Scene_PlayLevel::makePrototype(const LevelObject& object) const {
+	auto& assets = game->getAssets();
+	EntityPrototype prototype;
+	auto& components = prototype.components;
+
+	switch (object.type) {
+		case LevelObject::Type::Player:
+		{
+			prototype.tag = Entity::Tag::Player;
+			auto& cTransform = std::get<CTransform>(components);
+			cTransform.active = true;
+			cTransform.position = gridToPixel(object.grid);
+			auto& cAnimation = std::get<CAnimation>(components);
+			cAnimation.active = true;
+			cAnimation.animation.play(assets.getAnimation(levelAssets.stand));
+			cAnimation.loop = true;
+			cAnimation.layer = RenderLayer::Actors;
+			auto& cBoundingBox = std::get<CBoundingBox>(components);
+			cBoundingBox.active = true;
+			cBoundingBox.box = object.boundingBox;
+			std::get<CInput>(components).active = true;
+			std::get<CPlayerState>(components).active = true;
+			break;
+		}
+		case LevelObject::Type::Tile:
+		{
+			auto& cTransform = std::get<CTransform>(components);
+			cTransform.active = true;
+			cTransform.position = gridToPixel(object.grid);
+			auto& cAnimation = std::get<CAnimation>(components);
+			cAnimation.active = true;
+			cAnimation.animation.play(assets.getAnimation(levelAnimations[object.animation]));
+			cAnimation.loop = true;
+			auto& cBoundingBox = std::get<CBoundingBox>(components);
+			cBoundingBox.active = true;
+			cBoundingBox.box.position = cAnimation.animation.getSize() / -2;
+			cBoundingBox.box.size = cAnimation.animation.getSize();
+			if (levelAnimations[object.animation] == levelAssets.coinBox) {
+				std::get<CCoinBox>(components).active = true;
+			}
+			break;
+		}
+		case LevelObject::Type::Dec:
+		{
+			auto& cTransform = std::get<CTransform>(components);
+			cTransform.active = true;
+			cTransform.position = gridToPixel(object.grid);
+			auto& cAnimation = std::get<CAnimation>(components);
+			cAnimation.active = true;
+			cAnimation.animation.play(assets.getAnimation(levelAnimations[object.animation]));
+			cAnimation.loop = true;
+			cAnimation.layer = RenderLayer::Decoration;
+			break;
+		}
+	}
+	return prototype;
+}
+
+std::shared_ptr<const ChunkImage> Scene_PlayLevel::buildImage(std::vector<LevelObject> objects) const {
+	auto image = std::make_shared<ChunkImage>();
+	image->objects = std::move(objects);
+	image->prototypes.reserve(image->objects.size());
+	for (auto& object : image->objects) {
+		image->prototypes.push_back(makePrototype(object));
+	}
+	return image;
+}
+
+std::shared_ptr<const ChunkImage> Scene_PlayLevel::chunkImage(ChunkKey key) {
+	auto& image = chunkImages[key];
+	if (!image) {
+		image = buildImage(levelStream->load(key));
+	}
+	return image;
+}
+
+EntityPtr Scene_PlayLevel::instantiate(const LevelObject& object, const EntityPrototype& prototype) {
+	if (object.type == LevelObject::Type::Player) {
+		playerConfig = object.player;
+		return entities.create({ prototype.tag }, prototype.components);
+	}
+
+	// Apply what happened to the object before its chunk was unloaded
+	auto state = objectStates.find(levelObjectKey(object));
+	if (state != objectStates.end() && state->second.destroyed) {
+		return nullptr;
+	}
+	auto entity = entities.create({ prototype.tag }, prototype.components);
+	if (object.type == LevelObject::Type::Tile && state != objectStates.end() && state->second.usedCoinBox) {
+		entity->getComponent<CAnimation>().animation.play(game->getAssets().getAnimation(levelAssets.usedCoinBox));
+		entity->removeComponent<CCoinBox>();
+	}
+	return entity;
+}
+
+void Scene_PlayLevel::instantiate(LoadedChunk& chunk, std::shared_ptr<const ChunkImage> image) {
+	chunk.image = std::move(image);
+	chunk.entities.clear();
+	chunk.entities.reserve(chunk.image->objects.size());
+	for (size_t i = 0; i < chunk.image->objects.size(); i++) {
+		chunk.entities.push_back(instantiate(chunk.image->objects[i], chunk.image->prototypes[i]));
+	}
+}
+
+void Scene_PlayLevel::saveState(LevelSnapshot& snapshot) const {
+	snapshot.frame = frame;
+	snapshot.data.clear();
+	snapshot.images.clear();
+	SnapshotWriter writer(snapshot.data);
+	writer.write(frame);
+	writer.write(time);
+	writer.write(paused);
+	writer.write(windowScroll);
+	writer.write(previousWindowScroll);
+	writer.write(playerConfig.movementSpeed);
+	writer.write(playerConfig.jumpVelocity);
+	writer.write(playerConfig.maxSpeed);
+	writer.write(playerConfig.gravity);
+	writer.writeString(playerConfig.bulletAnimation);
+
+	entities.save(writer);
+
+	// Chunks refer to their entities by id, 0 for objects without one
+	auto saveChunk = [&](const LoadedChunk& chunk) {
+		snapshot.images.push_back(chunk.image);
+		writer.write((uint32_t)chunk.entities.size());
+		for (auto& entity : chunk.entities) {
+			writer.write((uint64_t)(entity ? entity->id() : 0));
+		}
+	};
+	saveChunk(players);
+	// Sorted, the map's order depends on how it was filled and equal states should give equal snapshots
+	std::vector<const std::pair<const ChunkKey, LoadedChunk>*> chunks;
+	chunks.reserve(loadedChunks.size());
+	for (auto& pair : loadedChunks) {
+		chunks.push_back(&pair);
+	}
+	std::sort(chunks.begin(), chunks.end(), [](auto a, auto b) {
+		return std::tie(a->first.y, a->first.x) < std::tie(b->first.y, b->first.x);
+	});
+	writer.write((uint32_t)chunks.size());
+	for (auto pair : chunks) {
+		writer.write(pair->first);
+		saveChunk(pair->second);
+	}
+
+	writer.write((uint32_t)objectStates.size());
+	for (auto& pair : objectStates) {
+		writer.write(std::get<0>(pair.first));
+		writer.write(std::get<1>(pair.first));
+		writer.write(std::get<2>(pair.first));
+		writer.write(pair.second);
+	}
+}
+
+void Scene_PlayLevel::loadState(const LevelSnapshot& snapshot) {
+	SnapshotReader reader(snapshot.data);
+	reader.read(frame);
+	reader.read(time);
+	reader.read(paused);
+	reader.read(windowScroll);
+	reader.read(previousWindowScroll);
+	reader.read(playerConfig.movementSpeed);
+	reader.read(playerConfig.jumpVelocity);
+	reader.read(playerConfig.maxSpeed);
+	reader.read(playerConfig.gravity);
+	reader.readString(playerConfig.bulletAnimation);
+
+	entities.restore(reader);
+
+	size_t nextImage = 0;
+	auto loadChunk = [&](LoadedChunk& chunk) {
+		chunk.image = snapshot.images.at(nextImage++);
+		chunk.entities.resize(reader.read<uint32_t>());
+		for (auto& entity : chunk.entities) {
+			auto id = reader.read<uint64_t>();
+			entity = id ? entities.find((EntityID)id) : nullptr;
+		}
+	};
+	loadChunk(players);
+	loadedChunks.clear();
+	uint32_t chunkCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < chunkCount; i++) {
+		loadChunk(loadedChunks[reader.read<ChunkKey>()]);
+	}
+
+	objectStates.clear();
+	uint32_t stateCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < stateCount; i++) {
+		auto type = reader.read<LevelObject::Type>();
+		auto x = reader.read<float>();
+		auto y = reader.read<float>();
+		reader.read(objectStates[LevelObjectKey(type, x, y)]);
+	}
+
+	// Chunks still being loaded are taken care of by sysStreaming as usual
+	drawList.clear();
+	drawListGeneration = UINT64_MAX;
+	levelAssets.bullet = game->getAssets().findAnimation(playerConfig.bulletAnimation);
+	retainTextures();
+}
+
+void Scene_PlayLevel::setDeterministic(bool enabled) {
+	deterministic = enabled;
+}
+
+bool Scene_PlayLevel::ready() {
+	if (loadingTextures) {
+		loadingTextures = !textureRefs.ready();
+	}
+	return !loadingTextures;
+}
 
-	levelSize = vec2::zero();
-
-	parsers["Player"] = [=](auto& instruction, auto& stream) {
-		float gridX = 0, gridY = 0, bboxX = 0, bboxY = 0, bboxW = 0, bboxH = 0;
-		if (!(stream
-			>> gridX
-			>> gridY
-			>> bboxX
-			>> bboxY
-			>> bboxW
-			>> bboxH
-			>> playerConfig.movementSpeed
-			>> playerConfig.maxSpeed
-			>> playerConfig.jumpVelocity
-			>> playerConfig.gravity
-			>> playerConfig.bulletAnimation
-			)) {
-			throw std::runtime_error("Level included faulty player config");
-		}
-
-		auto& player = entities.create({ Entity::Tag::Player });
-		auto& cTransform = player->addComponent<CTransform>();
-		cTransform.position = gridToPixel(vec2(gridX, gridY));
-		auto& cAnimation = player->addComponent<CAnimation>();
-		cAnimation.animation = assets.getAnimation("Stand");
-		cAnimation.loop = true;
-		auto& cBoundingBox = player->addComponent<CBoundingBox>();
-		cBoundingBox.box = rect(bboxX, bboxY, bboxW, bboxH);
-		player->addComponent<CInput>();
-		player->addComponent<CPlayerState>();
+void Scene_PlayLevel::saveState(LevelState& state) const {
+	state.frame = frame;
+	state.time = time;
+	state.paused = paused;
+	state.windowScroll = windowScroll;
+	state.previousWindowScroll = previousWindowScroll;
+	state.playerConfig = playerConfig;
+	entities.save(state.entities);
+
+	auto entityIds = [](const LoadedChunk& chunk, std::vector<EntityID>& ids) {
+		ids.clear();
+		for (auto& entity : chunk.entities) {
+			ids.push_back(entity ? entity->id() : 0);
+		}
 	};
-	parsers["Tile"] = [&](auto& instruction, auto& stream) {
-		float gridX = 0, gridY = 0;
-		std::string animation;
-		if (!(stream
-			>> gridX
-			>> gridY
-			>> animation
-			)) {
-			throw std::runtime_error("Level included faulty tile config");
-		}
-		levelSize.x = fmaxf(levelSize.x, gridX);
-		levelSize.y = fmaxf(levelSize.y, gridY);
-
-		auto& entity = entities.create({ Entity::Tag::World });
-		auto& cTransform = entity->addComponent<CTransform>();
-		cTransform.position = gridToPixel(vec2(gridX, gridY));
-		auto& cAnimation = entity->addComponent<CAnimation>();
-		cAnimation.animation = assets.getAnimation(animation);
-		cAnimation.loop = true;
-		auto& cBoundingBox = entity->addComponent<CBoundingBox>();
-		cBoundingBox.box.position = cAnimation.animation.getSize() / -2;
-		cBoundingBox.box.size = cAnimation.animation.getSize();
-		if (animation == "Question") {
-			entity->addComponent<CCoinBox>();
+	entityIds(players, state.players);
+	state.chunks.resize(loadedChunks.size());
+	size_t i = 0;
+	for (auto& pair : loadedChunks) {
+		state.chunks[i].first = pair.first;
+		entityIds(pair.second, state.chunks[i].second);
+		i++;
+	}
+	std::sort(state.chunks.begin(), state.chunks.end(), [](auto& a, auto& b) {
+		return std::tie(a.first.y, a.first.x) < std::tie(b.first.y, b.first.x);
+	});
+	state.objectStates.assign(objectStates.begin(), objectStates.end());
+}
+
+void Scene_PlayLevel::loadState(const LevelState& state) {
+	if (!playersImage) {
+		playersImage = buildImage(playerObjects());
+	}
+	// Check everything against the level before changing anything
+	std::vector<std::shared_ptr<const ChunkImage>> images;
+	images.reserve(state.chunks.size());
+	for (auto& chunk : state.chunks) {
+		images.push_back(chunkImage(chunk.first));
+		if (images.back()->objects.size() != chunk.second.size()) {
+			throw std::runtime_error("Saved level state doesn't match the level file");
+		}
+	}
+	if (playersImage->objects.size() != state.players.size()) {
+		throw std::runtime_error("Saved level state doesn't match the players of the level file");
+	}
+
+	frame = state.frame;
+	time = state.time;
+	paused = state.paused;
+	windowScroll = state.windowScroll;
+	previousWindowScroll = state.previousWindowScroll;
+	playerConfig = state.playerConfig;
+	entities.restore(state.entities);
+
+	auto restoreChunk = [&](LoadedChunk& chunk, std::shared_ptr<const ChunkImage> image, const std::vector<EntityID>& ids) {
+		chunk.image = std::move(image);
+		chunk.entities.clear();
+		for (auto id : ids) {
+			chunk.entities.push_back(id ? entities.find(id) : nullptr);
 		}
 	};
-	parsers["Dec"] = [&](auto& instruction, auto& stream) {
-		float gridX = 0, gridY = 0;
-		std::string animation;
-		if (!(stream
-			>> gridX
-			>> gridY
-			>> animation
-			)) {
-			throw std::runtime_error("Level included faulty dec config");
-		}
-		levelSize.x = fmaxf(levelSize.x, gridX);
-		levelSize.y = fmaxf(levelSize.y, gridY);
-
-		auto& entity = entities.create({ Entity::Tag::World });
-		auto& cTransform = entity->addComponent<CTransform>();
-		cTransform.position = gridToPixel(vec2(gridX, gridY));
-		auto& cAnimation = entity->addComponent<CAnimation>();
-		cAnimation.animation = assets.getAnimation(animation);
-		cAnimation.loop = true;
+	restoreChunk(players, playersImage, state.players);
+	loadedChunks.clear();
+	for (size_t i = 0; i < state.chunks.size(); i++) {
+		restoreChunk(loadedChunks[state.chunks[i].first], images[i], state.chunks[i].second);
+	}
+	objectStates = std::map<LevelObjectKey, LevelObjectState>(state.objectStates.begin(), state.objectStates.end());
+
+	drawList.clear();
+	drawListGeneration = UINT64_MAX;
+	levelAssets.bullet = game->getAssets().findAnimation(playerConfig.bulletAnimation);
+	retainTextures();
+}
+
+uint64_t Scene_PlayLevel::checksum() {
+	saveState(checksumState);
+	return levelStateChecksum(checksumState, checksumBytes);
+}
+
+void Scene_PlayLevel::clearSnapshots() {
+	savedState = LevelSnapshot();
+	history.clear();
+}
+
+void Scene_PlayLevel::retainTextures() {
+	auto& assets = game->getAssets();
+	std::vector<TextureHandle> handles;
+	for (auto animation : { levelAssets.stand, levelAssets.usedCoinBox, levelAssets.coin, levelAssets.bullet }) {
+		handles.push_back(TextureHandle{ assets.getAnimation(animation).textureId });
+	}
+	for (auto& pair : loadedChunks) {
+		for (auto& object : pair.second.image->objects) {
+			handles.push_back(TextureHandle{ assets.getAnimation(levelAnimations[object.animation]).textureId });
+		}
+	}
+	textureRefs.set(std::move(handles));
+}
+
+void Scene_PlayLevel::assetChanged(const AssetChange& change) {
+	auto& assets = game->getAssets();
+	if (change.type == AssetChange::Type::Level) {
+		if (assets.getLevel(LevelHandle{ change.index }).path == levelConfig.path) {
+			reloadLevel();
+		}
+	} else if (change.type == AssetChange::Type::Texture) {
+		// Prototypes have the old sizes baked in, they are rebuilt when next needed
+		chunkImages.clear();
+		playersImage = nullptr;
+		clearSnapshots();
+		// Tiles collide with the size of their sprite, follow the new image size
+		for (auto& pair : loadedChunks) {
+			for (auto& entity : pair.second.entities) {
+				if (entity && entity->hasComponent<CBoundingBox>() && entity->hasComponent<CAnimation>()) {
+					auto& animation = entity->getComponent<CAnimation>().animation;
+					if (animation.getTextureId() == change.index) {
+						auto& box = entity->getComponent<CBoundingBox>().box;
+						box.position = animation.getSize() / -2;
+						box.size = animation.getSize();
+					}
+				}
+			}
+		}
+	}
+}
+
+void Scene_PlayLevel::sysStreaming() {
+	ProfileZone zone("sysStreaming");
+	auto& settings = game->getSettings();
+	// Around the camera, and around every player so players off screen still have ground to stand on
+	std::vector<ChunkKey> centers = { cameraChunk() };
+	for (auto& player : players.entities) {
+		if (player && player->alive()) {
+			centers.push_back(levelStream->chunkAt(pixelToGrid(player->getComponent<CTransform>().position)));
+		}
+	}
+	auto distance = [&](ChunkKey key) {
+		int nearest = INT_MAX;
+		for (auto center : centers) {
+			nearest = std::min(nearest, std::max(std::abs(key.x - center.x), std::abs(key.y - center.y)));
+		}
+		return nearest;
 	};
+	// Chunks load within the radius and only unload once past the hysteresis, so walking back and forth over a border doesn't thrash
+	int keepRadius = settings.streamRadius + settings.streamHysteresis;
+
+	bool changed = false;
+	for (auto center : centers) {
+		for (auto key : levelStream->chunksAround(center, settings.streamRadius)) {
+			if (loadedChunks.find(key) != loadedChunks.end()) {
+				continue;
+			}
+			// Chunks parsed before don't need the loading thread, and neither does a deterministic simulation
+			auto image = chunkImages.find(key);
+			if (image != chunkImages.end()) {
+				loadChunk(key, image->second);
+				changed = true;
+			} else if (deterministic) {
+				loadChunk(key, chunkImage(key));
+				changed = true;
+			} else if (requestedChunks.insert(key).second) {
+				levelStream->request(key);
+			}
+		}
+	}
 
-	generic_parser(levelConfig.path, parsers);
+	ChunkKey key;
+	std::vector<LevelObject> objects;
+	while (levelStream->poll(key, objects)) {
+		requestedChunks.erase(key);
+		auto& image = chunkImages[key];
+		if (!image) {
+			image = buildImage(std::move(objects));
+		}
+		// The camera may have moved on while the chunk was loading
+		if (distance(key) <= keepRadius && loadedChunks.find(key) == loadedChunks.end()) {
+			loadChunk(key, image);
+			changed = true;
+		} else if (loadedChunks.find(key) == loadedChunks.end()) {
+			evictChunkImage(key);
+		}
+	}
+
+	for (auto it = loadedChunks.begin(); it != loadedChunks.end(); ) {
+		if (distance(it->first) > keepRadius) {
+			unloadChunk(it->second);
+			evictChunkImage(it->first);
+			it = loadedChunks.erase(it);
+			changed = true;
+		} else {
+			++it;
+		}
+	}
+
+	if (changed) {
+		retainTextures();
+	}
+}
+
+void Scene_PlayLevel::sysCamera() {
+	ProfileZone zone("sysCamera");
+	// Keep the player horizontally centered, without scrolling past the start of the level
+	for (auto& player : players.entities) {
+		if (player && player->alive()) {
+			auto& transform = player->getComponent<CTransform>();
+			windowScroll.x = fmaxf(0, transform.position.x - game->getViewSize().x / 2);
+		}
+	}
 }
 
 void Scene_PlayLevel::sysEntities() {
+	ProfileZone zone("sysEntities");
 	// TODO: Check if there are any entities outside the bounds of the level
 
 	// TODO: Check if players have dropped of the screen
@@ -186,16 +820,18 @@ void Scene_PlayLevel::sysEntities() {
 }
 
 void Scene_PlayLevel::sysGravity() {
+	ProfileZone zone("sysGravity");
 	for (auto& player : entities.list(Entity::Tag::Player)) {
 		auto& transform = player->getComponent<CTransform>();
 		auto& state = player->getComponent<CPlayerState>();
 		if (state.jumpStart == 0) {
-			transform.velocity.y += playerConfig.gravity;
+			transform.velocity.y += playerConfig.gravity * timeStep;
 		}
 	}
 }
 
 void Scene_PlayLevel::sysInput() {
+	ProfileZone zone("sysInput");
 	for (auto& player : entities.list(Entity::Tag::Player)) {
 		auto& playerTrans = player->getComponent<CTransform>();
 		auto& input = player->getComponent<CInput>();
@@ -218,9 +854,9 @@ void Scene_PlayLevel::sysInput() {
 		if (input.jump) {
 			if (state.canJump) {
 				state.canJump = false;
-				state.jumpStart = frame;
+				state.jumpStart = time;
 			}
-			int jumpingFrames = frame - state.jumpStart;
+			float jumpingFrames = time - state.jumpStart;
 			if (jumpingFrames < state.maxJumpLength) {
 				playerTrans.velocity.y = playerConfig.jumpVelocity;
 			} else {
@@ -238,6 +874,7 @@ void Scene_PlayLevel::sysInput() {
 }
 
 void Scene_PlayLevel::sysMovement() {
+	ProfileZone zone("sysMovement");
 	// Apply velocities
 	for (auto& entity : entities.list()) {
 		auto& transform = entity->getComponent<CTransform>();
@@ -248,8 +885,8 @@ void Scene_PlayLevel::sysMovement() {
 		}
 
 		// Update position
-		transform.position += transform.velocity;
-		transform.angle += transform.spin;
+		transform.position += transform.velocity * timeStep;
+		transform.angle += transform.spin * timeStep;
 	}
 }
 
@@ -274,6 +911,7 @@ rect entityWorldBox(const EntityPtr& entity) {
 }
 
 void Scene_PlayLevel::sysCollision() {
+	ProfileZone zone("sysCollision");
 	// Bullet collissions
 	for (auto& bullet : entities.list(Entity::Tag::Bullet)) {
 		auto bulletBox = entityWorldBox(bullet);
@@ -283,6 +921,7 @@ void Scene_PlayLevel::sysCollision() {
 			if (overlap.size.x > 0 && overlap.size.y > 0) {
 				entities.remove(bullet);
 				entities.remove(tile);
+				game->playSound(levelAssets.breakSound);
 				break;
 			}
 		}
@@ -335,113 +974,218 @@ void Scene_PlayLevel::sysCollision() {
 }
 
 void Scene_PlayLevel::sysAnimation() {
+	ProfileZone zone("sysAnimation");
+	// Looping animations are evaluated from the scene clock in getLoopIndex(), only one-shots need work here
 	for (auto& entity : entities.list()) {
 		if (entity->hasComponent<CAnimation>()) {
 			auto& animation = entity->getComponent<CAnimation>();
+			if (animation.loop) {
+				continue;
+			}
 			if (animation.animation.hasEnded()) {
-				// Handle end of animation
-				if (animation.loop) {
-					// Looping animations automatically reset
-					animation.animation.reset();
-				} else {
-					// Non-looping animations kill entity when finished
-					entities.remove(entity);
-				}
+				// Non-looping animations kill entity when finished
+				entities.remove(entity);
 			} else {
 				// Continue animation
-				animation.animation.update();
+				animation.animation.update(timeStep);
 			}
 		}
 	}
 }
 
-void Scene_PlayLevel::sysRender() {
-	auto& window = game->getWindow();
+uint64_t drawKey(const EntityPtr& entity) {
+	auto& animation = entity->getComponent<CAnimation>();
+	return makeDrawKey((uint8_t)animation.layer, animation.animation.getTextureId(), (uint32_t)entity->id());
+}
 
-	window.clear();
+void Scene_PlayLevel::updateDrawList() {
+	// Only sort again when entities came or went, or when one of them switched layer or texture
+	bool dirty = drawListGeneration != entities.generation();
+	for (size_t i = 0; !dirty && i < drawList.size(); i++) {
+		auto& item = drawList[i];
+		dirty = !item.entity->hasComponent<CAnimation>() || item.key != drawKey(item.entity);
+	}
+	if (!dirty) return;
+
+	drawList.clear();
+	for (auto& entity : entities.list()) {
+		if (entity->hasComponent<CAnimation>()) {
+			drawList.push_back({ drawKey(entity), entity });
+		}
+	}
+	radixSort(drawList, drawListScratch, [](const DrawItem& item) { return item.key; });
+	drawListGeneration = entities.generation();
+}
+
+int Scene_PlayLevel::getLoopIndex(const AnimationClip& clip) {
+	// Computed at most once per clip per frame, no matter how many entities share it
+	if (clip.id >= loopFrames.size()) {
+		loopFrames.resize(clip.id + 1);
+	}
+	auto& cached = loopFrames[clip.id];
+	if (cached.frame != frame) {
+		cached.frame = frame;
+		cached.index = clip.getLoopIndex(time);
+	}
+	return cached.index;
+}
 
+void Scene_PlayLevel::sysRender(RenderSnapshot& snapshot) {
+	ProfileZone zone("sysRender");
+	snapshot.previousCamera = previousWindowScroll;
+	snapshot.camera = windowScroll;
 	if (drawTextures) {
-		for (auto& entity : entities.list()) {
-			if (entity->hasComponent<CAnimation>()) {
-				auto& animation = entity->getComponent<CAnimation>();
-				sf::Sprite sprite = animation.animation.getSprite();
-
-				// Apply transform
-				if (entity->hasComponent<CTransform>()) {
-					auto& transform = entity->getComponent<CTransform>();
-					sprite.setRotation(to_degrees(transform.angle));
-					sprite.setScale(transform.scale);
-					sprite.setPosition(transform.position);
-				}
+		updateDrawList();
+		for (auto& item : drawList) {
+			auto& entity = item.entity;
+			auto& animation = entity->getComponent<CAnimation>();
+			auto& clip = animation.animation.getClip();
 
-				window.draw(sprite);
+			SpriteInstance instance;
+			instance.texture = clip.texture;
+			if (animation.loop) {
+				instance.textureRect = clip.getFrameRect(getLoopIndex(clip));
+			} else {
+				instance.textureRect = animation.animation.getFrameRect();
 			}
-		}
-	}
-	if (drawBoxes) {
-		sf::CircleShape pointShape(10.0f, 12);
-		pointShape.setFillColor(sf::Color::Transparent);
-		pointShape.setOutlineColor(sf::Color::Green);
-		pointShape.setOutlineThickness(1);
-		pointShape.setOrigin(pointShape.getRadius(), pointShape.getRadius());
-		sf::RectangleShape boxShape;
-		boxShape.setFillColor(sf::Color::Transparent);
-		boxShape.setOutlineColor(sf::Color::Red);
-		boxShape.setOutlineThickness(1);
-		for (auto& entity : entities.list()) {
+			instance.origin = clip.frameSize / 2;
+
+			// Apply transform
 			if (entity->hasComponent<CTransform>()) {
-				auto& pos = entity->getComponent<CTransform>().position;
-				pointShape.setPosition(pos);
-				window.draw(pointShape);
-				if (entity->hasComponent<CBoundingBox>()) {
-					auto& box = entity->getComponent<CBoundingBox>().box;
-					boxShape.setPosition(pos + box.position);
-					boxShape.setSize(box.size);
-					window.draw(boxShape);
-				}
+				auto& transform = entity->getComponent<CTransform>();
+				instance.angle = transform.angle;
+				instance.scale = transform.scale;
+				instance.previousPosition = transform.previousPosition;
+				instance.position = transform.position;
 			}
+
+			snapshot.sprites.push_back(instance);
 		}
 	}
+	if (loadingTextures) {
+		TextInstance label;
+		label.font = &game->getAssets().getFont(levelAssets.gridFont);
+		label.text = "Loading";
+		label.position = game->getViewSize() / 2;
+		label.centered = true;
+		snapshot.texts.push_back(label);
+	}
+	if (drawBoxes != DebugBoxMode::Off) {
+		buildDebugBoxes(snapshot.lines);
+	}
 	if (drawGrid) {
-		sf::RectangleShape shape;
-		shape.setSize(tileSize);
-		shape.setFillColor(sf::Color::Transparent);
-		shape.setOutlineColor(sf::Color::Yellow);
-		shape.setOutlineThickness(1);
-		sf::Text label;
-		label.setFont(game->getAssets().getFont("Arial"));
-		label.setFillColor(sf::Color::Yellow);
-
-		auto windowSize = window.getSize() + vec2::one();
-
-		for (int x = 0; x < windowSize.x; x += tileSize.x) {
-			for (int y = 0; y < windowSize.y; y += tileSize.y) {
-				shape.setPosition(x, y);
-				window.draw(shape);
-
-				auto gridPos = pixelToGrid(vec2(x, y) + (tileSize / 2));
-
-				if (gridPos.x <= levelSize.x && gridPos.y <= levelSize.y) {
-					std::ostringstream stringStream;
-					stringStream << "(" << gridPos.x << ", " << gridPos.y << ")";
-					label.setString(stringStream.str());
-					label.setPosition(x, y);
-					window.draw(label);
-				}
-			}
+		buildDebugGrid(snapshot);
+	}
+	if (drawPerf) {
+		buildPerfStats(snapshot.perf);
+	}
+}
+
+const sf::Color& tagColor(const EntityPtr& entity) {
+	static const sf::Color world = sf::Color::Red;
+	static const sf::Color player = sf::Color::Green;
+	static const sf::Color enemy = sf::Color::Magenta;
+	static const sf::Color bullet = sf::Color::Yellow;
+	if (entity->hasTag(Entity::Tag::Player)) return player;
+	if (entity->hasTag(Entity::Tag::Enemy)) return enemy;
+	if (entity->hasTag(Entity::Tag::Bullet)) return bullet;
+	return world;
+}
+
+const sf::Color& cellColor(const vec2& gridPos) {
+	static const sf::Color palette[] = {
+		sf::Color::Red,
+		sf::Color::Green,
+		sf::Color::Blue,
+		sf::Color::Yellow,
+		sf::Color::Magenta,
+		sf::Color::Cyan,
+	};
+	// 3x2 repeating pattern so neighbouring cells never share a color
+	int x = (int)floorf(gridPos.x + 0.5f);
+	int y = (int)floorf(gridPos.y + 0.5f);
+	int index = ((x % 3) + 3) % 3 + (((y % 2) + 2) % 2) * 3;
+	return palette[index];
+}
+
+void appendLine(sf::VertexArray& lines, const vec2& from, const vec2& to, const sf::Color& color) {
+	lines.append(sf::Vertex(from, color));
+	lines.append(sf::Vertex(to, color));
+}
+
+void Scene_PlayLevel::buildDebugBoxes(sf::VertexArray& lines) {
+	// All boxes and pivots go into a single line list, the snapshot keeps its capacity between frames
+	const float pivotSize = 10.0f;
+	for (auto& entity : entities.list()) {
+		if (!entity->hasComponent<CTransform>()) continue;
+		auto& pos = entity->getComponent<CTransform>().position;
+
+		sf::Color pivotColor = sf::Color::Green;
+		sf::Color boxColor = sf::Color::Red;
+		if (drawBoxes == DebugBoxMode::ByTag) {
+			pivotColor = boxColor = tagColor(entity);
+		} else if (drawBoxes == DebugBoxMode::ByCell) {
+			pivotColor = boxColor = cellColor(pixelToGrid(pos));
+		}
+
+		// Pivot marker as a cross
+		appendLine(lines, pos - vec2(pivotSize, 0), pos + vec2(pivotSize, 0), pivotColor);
+		appendLine(lines, pos - vec2(0, pivotSize), pos + vec2(0, pivotSize), pivotColor);
+
+		if (entity->hasComponent<CBoundingBox>()) {
+			auto box = entity->getComponent<CBoundingBox>().box;
+			box.position += pos;
+			vec2 topLeft(box.left(), box.top());
+			vec2 topRight(box.right(), box.top());
+			vec2 bottomLeft(box.left(), box.bottom());
+			vec2 bottomRight(box.right(), box.bottom());
+			appendLine(lines, topLeft, topRight, boxColor);
+			appendLine(lines, topRight, bottomRight, boxColor);
+			appendLine(lines, bottomRight, bottomLeft, boxColor);
+			appendLine(lines, bottomLeft, topLeft, boxColor);
 		}
 	}
+}
+
+void Scene_PlayLevel::buildDebugGrid(RenderSnapshot& snapshot) {
+	auto& font = game->getAssets().getFont(levelAssets.gridFont);
+	auto viewEnd = windowScroll + game->getViewSize() + vec2::one();
+	// Cells overlapping the view
+	float startX = floorf(windowScroll.x / tileSize.x) * tileSize.x;
+	float startY = floorf(windowScroll.y / tileSize.y) * tileSize.y;
+
+	for (float x = startX; x < viewEnd.x; x += tileSize.x) {
+		for (float y = startY; y < viewEnd.y; y += tileSize.y) {
+			vec2 topLeft(x, y);
+			appendLine(snapshot.lines, topLeft, topLeft + vec2(tileSize.x, 0), sf::Color::Yellow);
+			appendLine(snapshot.lines, topLeft, topLeft + vec2(0, tileSize.y), sf::Color::Yellow);
+
+			auto gridPos = pixelToGrid(topLeft + (tileSize / 2));
 
-	window.display();
+			if (gridPos.x <= levelSize.x && gridPos.y <= levelSize.y) {
+				std::ostringstream stringStream;
+				stringStream << "(" << gridPos.x << ", " << gridPos.y << ")";
+				TextInstance label;
+				label.font = &font;
+				label.text = stringStream.str();
+				label.color = sf::Color::Yellow;
+				label.position = topLeft;
+				label.world = true;
+				snapshot.texts.push_back(label);
+			}
+		}
+	}
 }
 
 void Scene_PlayLevel::sysPreviousPosition() {
+	ProfileZone zone("sysPreviousPosition");
 	for (auto& entity : entities.list()) {
 		if (entity->hasComponent<CTransform>()) {
 			auto& transform = entity->getComponent<CTransform>();
 			transform.previousPosition = transform.position;
 		}
 	}
+	previousWindowScroll = windowScroll;
 }
 
 void Scene_PlayLevel::onShootBullet(const EntityPtr& player) {
@@ -459,11 +1203,14 @@ void Scene_PlayLevel::onShootBullet(const EntityPtr& player) {
 
 	auto& bulletAnim = bullet->addComponent<CAnimation>();
 	bulletAnim.loop = true;
-	bulletAnim.animation = game->getAssets().getAnimation(playerConfig.bulletAnimation);
+	bulletAnim.layer = RenderLayer::Effects;
+	bulletAnim.animation.play(game->getAssets().getAnimation(levelAssets.bullet));
 
 	auto& bulletBox = bullet->addComponent<CBoundingBox>();
 	auto bulletSize = vec2(bulletAnim.animation.getSize());
 	bulletBox.box = rect(bulletSize / -2.0f, bulletSize);
+
+	game->playSound(levelAssets.shootSound);
 }
 
 void Scene_PlayLevel::onCollision(const EntityPtr& player, const EntityPtr& tile, const rect& overlap) {
@@ -508,12 +1255,13 @@ void Scene_PlayLevel::onCoinBoxHit(const EntityPtr& player, const EntityPtr& til
 	auto& assets = game->getAssets();
 	auto& tileTrans = tile->getComponent<CTransform>();
 	auto& tileAnim = tile->getComponent<CAnimation>();
-	tileAnim.animation = assets.getAnimation("Question2");
+	tileAnim.animation.play(assets.getAnimation(levelAssets.usedCoinBox));
 
 	// TODO: Show coin
 	auto& coin = entities.create({ Entity::Tag::World });
 	auto& coinAnim = coin->addComponent<CAnimation>();
-	coinAnim.animation = assets.getAnimation("Coin");
+	coinAnim.animation.play(assets.getAnimation(levelAssets.coin));
+	coinAnim.layer = RenderLayer::Items;
 
 	auto& coinTrans = coin->addComponent<CTransform>();
 	auto tileHeight = tile->getComponent<CAnimation>().animation.getSize().y;
@@ -522,4 +1270,48 @@ void Scene_PlayLevel::onCoinBoxHit(const EntityPtr& player, const EntityPtr& til
 	coinTrans.position.y -= (tileHeight / 2) + (coinHeight / 2);
 
 	tile->removeComponent<CCoinBox>();
+	game->playSound(levelAssets.coinSound);
+}
+
+// Names of the ComponentTuple types in the performance overlay
+static const char* const componentNames[] = { "CTransform", "CInput", "CPlayerState", "CBoundingBox", "CAnimation", "CCoinBox" };
+static_assert(std::size(componentNames) == std::tuple_size_v<ComponentTuple>, "Every component needs a name");
+
+template<typename... Components>
+static void countComponents(const EntityPtr& entity, std::vector<std::pair<const char*, int>>& counts, std::tuple<Components...>*) {
+	size_t i = 0;
+	((counts[i++].second += entity->hasComponent<Components>() ? 1 : 0), ...);
+}
+
+void Scene_PlayLevel::buildPerfStats(PerfStats& stats) {
+	stats.visible = true;
+	stats.font = &game->getAssets().getFont(levelAssets.gridFont);
+	stats.tickBudget = 1e6f / game->getSettings().tickRate;
+	stats.tickAllocations = tickAllocations;
+
+	// Zones of the latest tick in the order they ran, the tick itself first
+	Profiler::lastFrame(perfZones);
+	if (!perfZones.empty()) {
+		stats.tickTime = (perfZones.front().end - perfZones.front().start) / 1000.0f;
+		for (auto it = perfZones.rbegin(); it != std::prev(perfZones.rend()); ++it) {
+			stats.systems.emplace_back(it->name, (it->end - it->start) / 1000.0f);
+		}
+	}
+
+	stats.entities = (int)entities.list().size();
+	static const std::pair<const char*, Entity::Tag> tags[] = {
+		{ "World", Entity::Tag::World },
+		{ "Player", Entity::Tag::Player },
+		{ "Enemy", Entity::Tag::Enemy },
+		{ "Bullet", Entity::Tag::Bullet },
+	};
+	for (auto& tag : tags) {
+		stats.tags.emplace_back(tag.first, (int)entities.list(tag.second).size());
+	}
+	for (auto name : componentNames) {
+		stats.components.emplace_back(name, 0);
+	}
+	for (auto& entity : entities.list()) {
+		countComponents(entity, stats.components, (ComponentTuple*)nullptr);
+	}
 }
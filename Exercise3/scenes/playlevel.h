@@ -1,35 +1,184 @@
 #pragma once
 
+#include <map>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 #include "../assets.h"
+#include "../profiler.h"
 #include "../scene.h"
+#include "levelstream.h"
 
-struct PlayerConfig
+typedef std::tuple<LevelObject::Type, float, float> LevelObjectKey;
+
+// Objects are identified by their type and cell, so they can be matched across reloads and unloads
+inline LevelObjectKey levelObjectKey(const LevelObject& object) {
+	return LevelObjectKey(object.type, object.grid.x, object.grid.y);
+}
+
+// Entity as a level object spawns it, before anything happens to it during play
+struct EntityPrototype
+{
+	Entity::Tag tag = Entity::Tag::World;
+	ComponentTuple components;
+};
+
+// Parsed level objects with the entities they spawn. Built once and shared, never changed afterwards.
+struct ChunkImage
+{
+	std::vector<LevelObject> objects;
+	std::vector<EntityPrototype> prototypes;
+};
+
+// Level objects that are instantiated, with the entity spawned for each (null when destroyed)
+struct LoadedChunk
+{
+	std::shared_ptr<const ChunkImage> image;
+	EntityList entities;
+};
+
+// Changes made to level objects during play, kept while their chunk is unloaded
+struct LevelObjectState
+{
+	bool destroyed = false;
+	bool usedCoinBox = false;
+};
+
+struct LevelDiff
+{
+	int added = 0;
+	int changed = 0;
+	int removed = 0;
+};
+
+// Assets used during gameplay, resolved once when the level is loaded
+struct LevelAssets
+{
+	AnimationHandle stand;
+	AnimationHandle coinBox;
+	AnimationHandle usedCoinBox;
+	AnimationHandle coin;
+	AnimationHandle bullet;
+	FontHandle gridFont;
+	// Optional, invalid when assets.txt doesn't list them
+	SoundHandle shootSound;
+	SoundHandle coinSound;
+	SoundHandle breakSound;
+	MusicHandle music; // named after the level
+};
+
+// A level during play has two state formats, pick by where the state goes:
+//
+// LevelSnapshot is for saving and restoring within this process, every tick if need be: the quick save,
+// rewind history and rollback frames. Components are copied byte for byte with their padding and asset
+// pointers, which makes saving about a memcpy and restoring allocation free once warmed up. Its bytes are
+// not canonical, so never hash or compare them, and never write them out.
+//
+// LevelState is for anything that leaves the scene: state recordings, seeking and checksums (replays and
+// rollback desync checks). Plain structures that levelStateChecksum and the state recorder encode field
+// by field, with animation clips by name, so equal states encode the same in any process. Saving one
+// copies every entity into new structures and costs more than taking a snapshot.
+
+// Complete state of a level during play. Chunk images are shared with the level image rather than copied.
+struct LevelSnapshot
+{
+	int frame = 0;
+	std::vector<uint8_t> data;
+	std::vector<std::shared_ptr<const ChunkImage>> images; // players first, then the loaded chunks in the order saved
+};
+
+// Level state as plain structures, for encoding it portably, see above.
+// Chunks are referred to by key and rebuilt from the level file when the state is loaded.
+struct LevelState
+{
+	int frame = 0;
+	float time = 0;
+	bool paused = false;
+	vec2 windowScroll = vec2::zero();
+	vec2 previousWindowScroll = vec2::zero();
+	PlayerConfig playerConfig;
+	EntitiesState entities;
+	// Entity ids in the order of the chunk's objects, 0 for objects without an entity
+	std::vector<EntityID> players;
+	std::vector<std::pair<ChunkKey, std::vector<EntityID>>> chunks; // sorted by y, then x
+	std::vector<std::pair<LevelObjectKey, LevelObjectState>> objectStates; // sorted by key
+};
+
+enum class DebugBoxMode
+{
+	Off,
+	Plain, // Boxes in red, pivots in green
+	ByTag, // Colored by the entity's primary tag
+	ByCell, // Colored by the grid cell the pivot lies in
+};
+
+struct LoopFrame
 {
-	float movementSpeed = 0;
-	float jumpVelocity = 0;
-	float maxSpeed = 0;
-	float gravity = 0;
-	std::string bulletAnimation;
+	int frame = -1; // scene frame for which index was computed
+	int index = 0;
+};
+
+struct DrawItem
+{
+	uint64_t key;
+	EntityPtr entity;
 };
 
 class Scene_PlayLevel : public Scene
 {
 public:
-	Scene_PlayLevel(GameEngine* game) : Scene(game) {}
+	Scene_PlayLevel(GameEngine* game);
 
 	void enter();
 	void leave();
 	void perform(const Command& action);
 	void tick();
+	void render(RenderSnapshot& snapshot);
+
+	void assetChanged(const AssetChange& change);
 
 	void setLevel(const LevelConfig& config);
 	void resetLevel();
+	// Applies changes to the level file without restarting the level
+	void reloadLevel();
 
 	vec2 gridToPixel(const vec2& gridPos) const;
 	vec2 pixelToGrid(const vec2& screenPos) const;
 	vec2 getTileSize() const { return tileSize; }
 
+	// Snapshots hold pointers to assets, they are only valid until the assets they use are reloaded.
+	// See LevelSnapshot and LevelState for which to use.
+	void saveState(LevelSnapshot& snapshot) const;
+	void loadState(const LevelSnapshot& snapshot);
+	void saveState(LevelState& state) const;
+	// Throws when the state doesn't fit the level file, like after the file was edited
+	void loadState(const LevelState& state);
+
+	// Makes ticks depend on nothing but the state and the commands performed, for rollback netplay:
+	// chunks are loaded on the simulation thread instead of arriving whenever the loading thread is done
+	void setDeterministic(bool enabled);
+	// False while the textures needed to start are loading
+	bool ready();
+	// Of the state encoded field by field, equal for equal states in any scene and process
+	uint64_t checksum();
+
 private:
+	EntityPrototype makePrototype(const LevelObject& object) const;
+	std::shared_ptr<const ChunkImage> buildImage(std::vector<LevelObject> objects) const;
+	std::shared_ptr<const ChunkImage> chunkImage(ChunkKey key);
+	EntityPtr instantiate(const LevelObject& object, const EntityPrototype& prototype);
+	void instantiate(LoadedChunk& chunk, std::shared_ptr<const ChunkImage> image);
+	void loadChunk(ChunkKey key, std::shared_ptr<const ChunkImage> image);
+	void unloadChunk(LoadedChunk& chunk);
+	void diffChunk(LoadedChunk& chunk, std::vector<LevelObject> objects, const std::vector<AnimationHandle>& previousAnimations, LevelDiff& diff);
+	std::vector<AnimationHandle> resolveAnimations(const LevelStream& stream) const;
+	std::vector<LevelObject> playerObjects() const;
+	ChunkKey cameraChunk() const;
+	void retainTextures();
+	void evictChunkImage(ChunkKey key);
+	void clearSnapshots();
+
 	// Systems
 	void sysEntities();
 	void sysGravity();
@@ -37,7 +186,14 @@ private:
 	void sysMovement();
 	void sysCollision();
 	void sysAnimation();
-	void sysRender();
+	void sysCamera();
+	void sysStreaming();
+	void sysRender(RenderSnapshot& snapshot);
+	void updateDrawList();
+	int getLoopIndex(const AnimationClip& clip);
+	void buildDebugBoxes(sf::VertexArray& lines);
+	void buildDebugGrid(RenderSnapshot& snapshot);
+	void buildPerfStats(PerfStats& stats);
 	void sysPreviousPosition();
 
 	void onShootBullet(const EntityPtr& player);
@@ -46,13 +202,55 @@ private:
 
 	// Data
 	int frame = 0;
+	float time = 0; // gameplay time in reference frames, advances by timeStep every tick
+	float timeStep = 1;
 	bool paused = false;
 	LevelConfig levelConfig;
+	// Level contents, only the chunks around the camera are instantiated.
+	// Replaced as a whole on reload, so a faulty edit leaves the previous one streaming.
+	std::unique_ptr<LevelStream> levelStream = std::make_unique<LevelStream>();
+	std::vector<AnimationHandle> levelAnimations; // indexed by LevelObject::animation
+	LoadedChunk players;
+	std::unordered_map<ChunkKey, LoadedChunk, ChunkKeyHash> loadedChunks;
+	std::unordered_set<ChunkKey, ChunkKeyHash> requestedChunks;
+	std::map<LevelObjectKey, LevelObjectState> objectStates;
+	// Level image: every chunk parsed so far, kept across restarts and re-entries until the file changes
+	// Only the images of loaded chunks and of the chunks a restart begins in are kept, so the cache
+	// stays the size of the streamed area however far the players go
+	std::unordered_map<ChunkKey, std::shared_ptr<const ChunkImage>, ChunkKeyHash> chunkImages;
+	std::unordered_set<ChunkKey, ChunkKeyHash> startChunks;
+	std::shared_ptr<const ChunkImage> playersImage;
 	vec2 tileSize = vec2(128, 128);
-	vec2 windowScroll = vec2::zero();
+	vec2 windowScroll = vec2::zero(); // top left of the view in pixels
+	vec2 previousWindowScroll = vec2::zero();
 	vec2 levelSize = vec2::zero();
 	PlayerConfig playerConfig;
+	LevelAssets levelAssets;
+	// Textures used by the loaded chunks, the simulation waits for them after a reset
+	AssetReferences textureRefs;
+	bool loadingTextures = false;
+	bool deterministic = false;
 	bool drawTextures = true;
-	bool drawBoxes = false;
+	DebugBoxMode drawBoxes = DebugBoxMode::Off;
 	bool drawGrid = false;
+	// Performance overlay, the profiler runs while it is shown
+	bool drawPerf = false;
+	std::vector<ProfileEvent> perfZones;
+	uint64_t tickAllocations = 0;
+
+	LevelState checksumState;
+	std::vector<uint8_t> checksumBytes;
+	// Quick save, empty data when nothing was saved
+	LevelSnapshot savedState;
+	// One snapshot per tick while rewinding is enabled, stepped back through while Rewind is held
+	SnapshotRing<LevelSnapshot> history;
+	bool rewinding = false;
+
+	// Entities with an animation, sorted by draw key
+	std::vector<DrawItem> drawList;
+	std::vector<DrawItem> drawListScratch;
+	uint64_t drawListGeneration = UINT64_MAX;
+
+	// Current frame of every looping clip, indexed by clip id
+	std::vector<LoopFrame> loopFrames;
 };
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Appends state to a contiguous buffer. Values are copied byte for byte, so snapshots are only
+// meant to be read back by the same build during the same run (they can contain pointers to assets).
+class SnapshotWriter
+{
+public:
+	explicit SnapshotWriter(std::vector<uint8_t>& buffer)
+		: buffer(buffer) {
+	}
+
+	template<typename T>
+	void write(const T& value) {
+		static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be written to a snapshot");
+		write(&value, sizeof(T));
+	}
+
+	void write(const void* data, size_t size) {
+		size_t offset = buffer.size();
+		// Cleared buffers keep their capacity, so once warmed up this doesn't allocate
+		buffer.resize(offset + size);
+		std::memcpy(buffer.data() + offset, data, size);
+	}
+
+	void writeString(const std::string& text) {
+		write((uint32_t)text.size());
+		write(text.data(), text.size());
+	}
+
+	// 7 bits per byte, small numbers take a single byte
+	void writeVarint(uint64_t value) {
+		while (value >= 0x80) {
+			write((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		write((uint8_t)value);
+	}
+
+	size_t size() const { return buffer.size(); }
+
+private:
+	std::vector<uint8_t>& buffer;
+};
+
+// FNV-1a over encoded bytes. Snapshots of equal states can differ in padding, levelStateChecksum hashes the state itself.
+inline uint64_t snapshotChecksum(const std::vector<uint8_t>& data) {
+	uint64_t hash = 14695981039346656037ull;
+	for (uint8_t byte : data) {
+		hash ^= byte;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Reads state back in the order it was written, throws when reading past the end
+class SnapshotReader
+{
+public:
+	explicit SnapshotReader(const std::vector<uint8_t>& buffer)
+		: position(buffer.data())
+		, end(buffer.data() + buffer.size()) {
+	}
+	SnapshotReader(const uint8_t* data, size_t size)
+		: position(data)
+		, end(data + size) {
+	}
+
+	bool atEnd() const { return position == end; }
+
+	template<typename T>
+	void read(T& value) {
+		static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be read from a snapshot");
+		read(&value, sizeof(T));
+	}
+
+	template<typename T>
+	T read() {
+		T value;
+		read(value);
+		return value;
+	}
+
+	void read(void* data, size_t size) {
+		if (size > (size_t)(end - position)) {
+			throw std::runtime_error("Snapshot is truncated");
+		}
+		std::memcpy(data, position, size);
+		position += size;
+	}
+
+	uint64_t readVarint() {
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			uint8_t byte = read<uint8_t>();
+			value |= (uint64_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) {
+				return value;
+			}
+		}
+		throw std::runtime_error("Snapshot has a malformed number");
+	}
+
+	void readString(std::string& text) {
+		uint32_t length = read<uint32_t>();
+		if (length > (size_t)(end - position)) {
+			throw std::runtime_error("Snapshot is truncated");
+		}
+		text.assign((const char*)position, length);
+		position += length;
+	}
+
+private:
+	const uint8_t* position;
+	const uint8_t* end;
+};
+
+// The most recent snapshots, oldest overwritten first. Slots are reused, so their buffers
+// keep their capacity and taking a snapshot every tick doesn't allocate once the ring went round.
+template<typename T>
+class SnapshotRing
+{
+public:
+	explicit SnapshotRing(size_t capacity = 0)
+		: slots(capacity) {
+	}
+
+	size_t capacity() const { return slots.size(); }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	// Slot for a new snapshot, overwriting the oldest when full. The caller clears and fills it.
+	T& push() {
+		if (slots.empty()) {
+			throw std::logic_error("Snapshot ring has no capacity");
+		}
+		T& slot = slots[(first + count) % slots.size()];
+		if (count == slots.size()) {
+			first = (first + 1) % slots.size();
+		} else {
+			count++;
+		}
+		return slot;
+	}
+
+	// 0 is the most recent snapshot
+	T& recent(size_t age) {
+		return slots[(first + count - 1 - age) % slots.size()];
+	}
+	T& oldest() {
+		return slots[first];
+	}
+
+	// Forgets the newest snapshots, e.g. after rewinding to an older one
+	void dropRecent(size_t number) {
+		count -= std::min(number, count);
+	}
+	void clear() {
+		first = 0;
+		count = 0;
+	}
+
+private:
+	std::vector<T> slots;
+	size_t first = 0;
+	size_t count = 0;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free queue for exactly one producer thread and one consumer thread.
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	// Producer side, returns false when the queue is full
+	bool push(const T& item) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+		m_items[tail & mask] = item;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, returns false when the queue is empty
+	bool pop(T& item) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = m_items[head & mask];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	static constexpr size_t mask = Capacity - 1;
+
+	// Head and tail live on separate cache lines so the two threads don't fight over them
+	alignas(64) std::atomic<size_t> m_head = 0;
+	alignas(64) std::atomic<size_t> m_tail = 0;
+	T m_items[Capacity];
+};
@@ -0,0 +1,614 @@
+#include "staterecording.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// "E3SR"
+static const uint32_t stateRecordingMagic = 0x52533345;
+static const uint32_t stateRecordingVersion = 2;
+// Magic, version and the size of the replay header that follows
+static const size_t fileHeaderSize = 3 * sizeof(uint32_t);
+// First tick, tick count, size of the clip names, size of the block
+static const size_t blockHeaderSize = 4 * sizeof(uint32_t);
+
+static void writeVec2(SnapshotWriter& writer, const vec2& value) {
+	writer.write(value.x);
+	writer.write(value.y);
+}
+
+static vec2 readVec2(SnapshotReader& reader) {
+	vec2 value;
+	reader.read(value.x);
+	reader.read(value.y);
+	return value;
+}
+
+// Components are written field by field, padding would otherwise make unchanged components look changed
+
+static void encodeComponent(SnapshotWriter& writer, const CTransform& component) {
+	writer.write((uint8_t)component.active);
+	writeVec2(writer, component.position);
+	writeVec2(writer, component.previousPosition);
+	writeVec2(writer, component.scale);
+	writeVec2(writer, component.velocity);
+	writer.write(component.angle);
+	writer.write(component.spin);
+}
+
+static void decodeComponent(SnapshotReader& reader, CTransform& component, const std::vector<const AnimationClip*>&) {
+	component.active = reader.read<uint8_t>() != 0;
+	component.position = readVec2(reader);
+	component.previousPosition = readVec2(reader);
+	component.scale = readVec2(reader);
+	component.velocity = readVec2(reader);
+	reader.read(component.angle);
+	reader.read(component.spin);
+}
+
+static void encodeComponent(SnapshotWriter& writer, const CInput& component) {
+	writer.write((uint8_t)(component.active | component.left << 1 | component.right << 2 | component.jump << 3 | component.shoot << 4));
+}
+
+static void decodeComponent(SnapshotReader& reader, CInput& component, const std::vector<const AnimationClip*>&) {
+	uint8_t bits = reader.read<uint8_t>();
+	component.active = bits & 1;
+	component.left = bits & 2;
+	component.right = bits & 4;
+	component.jump = bits & 8;
+	component.shoot = bits & 16;
+}
+
+static void encodeComponent(SnapshotWriter& writer, const CPlayerState& component) {
+	writer.write((uint8_t)(component.active | component.canJump << 1));
+	writer.write(component.jumpStart);
+	writer.write(component.maxJumpLength);
+}
+
+static void decodeComponent(SnapshotReader& reader, CPlayerState& component, const std::vector<const AnimationClip*>&) {
+	uint8_t bits = reader.read<uint8_t>();
+	component.active = bits & 1;
+	component.canJump = bits & 2;
+	reader.read(component.jumpStart);
+	reader.read(component.maxJumpLength);
+}
+
+static void encodeComponent(SnapshotWriter& writer, const CBoundingBox& component) {
+	writer.write((uint8_t)component.active);
+	writeVec2(writer, component.box.position);
+	writeVec2(writer, component.box.size);
+}
+
+static void decodeComponent(SnapshotReader& reader, CBoundingBox& component, const std::vector<const AnimationClip*>&) {
+	component.active = reader.read<uint8_t>() != 0;
+	component.box.position = readVec2(reader);
+	component.box.size = readVec2(reader);
+}
+
+static void decodeComponent(SnapshotReader& reader, CAnimation& component, const std::vector<const AnimationClip*>& clips) {
+	uint8_t bits = reader.read<uint8_t>();
+	component.active = bits & 1;
+	component.loop = bits & 2;
+	component.layer = (RenderLayer)reader.read<uint8_t>();
+	uint64_t clip = reader.readVarint();
+	int index = (int)reader.readVarint();
+	float timer = reader.read<float>();
+	if (clip >= clips.size()) {
+		throw std::runtime_error("State recording refers to an unknown animation");
+	}
+	component.animation = Animation();
+	if (clips[clip]) {
+		component.animation.play(*clips[clip]);
+	}
+	component.animation.seek(index, timer);
+}
+
+static void encodeComponent(SnapshotWriter& writer, const CCoinBox& component) {
+	writer.write((uint8_t)(component.active | component.hit << 1));
+}
+
+static void decodeComponent(SnapshotReader& reader, CCoinBox& component, const std::vector<const AnimationClip*>&) {
+	uint8_t bits = reader.read<uint8_t>();
+	component.active = bits & 1;
+	component.hit = bits & 2;
+}
+
+// Entity header then one section per component, sections gets the start of each section and the end.
+// Clips are written by writeClip, the only part that differs between recordings and checksums.
+template<typename ClipWriter>
+static void encodeEntity(SnapshotWriter& writer, const EntityState& entity, ClipWriter writeClip, uint32_t* sections) {
+	sections[0] = (uint32_t)writer.size();
+	writer.write((uint8_t)(entity.dead | entity.baby << 1));
+	writer.writeVarint(entity.tags);
+
+	size_t section = 1;
+	std::apply([&](const auto&... components) {
+		auto encodeSection = [&](const auto& component) {
+			sections[section++] = (uint32_t)writer.size();
+			using Component = std::decay_t<decltype(component)>;
+			if constexpr (std::is_same_v<Component, CAnimation>) {
+				writer.write((uint8_t)(component.active | component.loop << 1));
+				writer.write((uint8_t)component.layer);
+				writeClip(writer, component.animation);
+				writer.writeVarint((uint32_t)component.animation.getIndex());
+				writer.write(component.animation.getTimer());
+			} else {
+				encodeComponent(writer, component);
+			}
+		};
+		(encodeSection(components), ...);
+	}, entity.components);
+	sections[entitySectionCount] = (uint32_t)writer.size();
+}
+
+// Changes every tick
+static void encodeScalars(SnapshotWriter& writer, const LevelState& state) {
+	writer.writeVarint((uint32_t)state.frame);
+	writer.write(state.time);
+	writer.write((uint8_t)state.paused);
+	writeVec2(writer, state.windowScroll);
+	writeVec2(writer, state.previousWindowScroll);
+	writer.writeVarint(state.entities.counter);
+}
+
+// Changes now and then, when chunks stream and objects are used up
+static void encodeStructure(SnapshotWriter& writer, const LevelState& state) {
+	writer.write(state.playerConfig.movementSpeed);
+	writer.write(state.playerConfig.jumpVelocity);
+	writer.write(state.playerConfig.maxSpeed);
+	writer.write(state.playerConfig.gravity);
+	writer.writeString(state.playerConfig.bulletAnimation);
+
+	auto writeIds = [&](const std::vector<EntityID>& ids) {
+		writer.writeVarint(ids.size());
+		for (auto id : ids) {
+			writer.writeVarint(id);
+		}
+	};
+	writeIds(state.players);
+	writer.writeVarint(state.chunks.size());
+	for (auto& chunk : state.chunks) {
+		writer.write((int32_t)chunk.first.x);
+		writer.write((int32_t)chunk.first.y);
+		writeIds(chunk.second);
+	}
+	writer.writeVarint(state.objectStates.size());
+	for (auto& pair : state.objectStates) {
+		writer.write((uint8_t)std::get<0>(pair.first));
+		writer.write(std::get<1>(pair.first));
+		writer.write(std::get<2>(pair.first));
+		writer.write((uint8_t)(pair.second.destroyed | pair.second.usedCoinBox << 1));
+	}
+}
+
+uint64_t levelStateChecksum(const LevelState& state, std::vector<uint8_t>& buffer) {
+	buffer.clear();
+	SnapshotWriter writer(buffer);
+	encodeScalars(writer, state);
+	encodeStructure(writer, state);
+	writer.writeVarint(state.entities.entities.size());
+	std::array<uint32_t, entitySectionCount + 1> sections;
+	for (auto& entity : state.entities.entities) {
+		writer.writeVarint(entity.id);
+		// By name, clip addresses differ between runs and machines
+		encodeEntity(writer, entity, [](SnapshotWriter& writer, const Animation& animation) {
+			writer.writeString(animation.hasClip() ? animation.getClip().name : "");
+		}, sections.data());
+	}
+	return snapshotChecksum(buffer);
+}
+
+StateRecorder::StateRecorder(const std::string& path, const ReplayHeader& header, int keyframeInterval)
+	: file(path, std::ios::binary | std::ios::trunc)
+	, keyframeInterval(std::max(1, keyframeInterval)) {
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to create state recording " + path);
+	}
+	std::vector<uint8_t> replayHeader;
+	SnapshotWriter replayWriter(replayHeader);
+	writeReplayHeader(replayWriter, header);
+	SnapshotWriter writer(block);
+	writer.write(stateRecordingMagic);
+	writer.write(stateRecordingVersion);
+	writer.write((uint32_t)replayHeader.size());
+	writer.write(replayHeader.data(), replayHeader.size());
+	file.write((const char*)block.data(), block.size());
+	file.flush();
+	offset = block.size();
+	block.clear();
+	clipNames.push_back("");
+}
+
+StateRecorder::~StateRecorder() {
+	if (!block.empty()) {
+		finishBlock();
+	}
+}
+
+uint32_t StateRecorder::clipIndex(const Animation& animation) {
+	if (!animation.hasClip()) {
+		return 0;
+	}
+	auto clip = &animation.getClip();
+	auto found = clipIndices.find(clip);
+	if (found != clipIndices.end()) {
+		return found->second;
+	}
+	uint32_t index = (uint32_t)clipNames.size();
+	clipIndices.emplace(clip, index);
+	clipNames.push_back(clip->name);
+	return index;
+}
+
+void StateRecorder::encode(const EntityState& entity, EncodedEntity& encoded) {
+	encoded.id = entity.id;
+	encoded.bytes.clear();
+	SnapshotWriter writer(encoded.bytes);
+	encodeEntity(writer, entity, [this](SnapshotWriter& writer, const Animation& animation) {
+		writer.writeVarint(clipIndex(animation));
+	}, encoded.sections.data());
+}
+
+void StateRecorder::record(int tick, const LevelState& state) {
+	if (lastTick >= 0 && tick != lastTick + 1) {
+		throw std::logic_error("State recordings need every tick in order");
+	}
+	lastTick = tick;
+
+	auto& entities = state.entities.entities;
+	current.resize(entities.size());
+	for (size_t i = 0; i < entities.size(); i++) {
+		encode(entities[i], current[i]);
+	}
+	structure.clear();
+	SnapshotWriter structureWriter(structure);
+	encodeStructure(structureWriter, state);
+
+	if (!block.empty() && blockTicks >= keyframeInterval) {
+		finishBlock();
+	}
+	bool keyframe = block.empty();
+	if (keyframe) {
+		blockFirstTick = tick;
+	}
+
+	SnapshotWriter writer(block);
+	encodeScalars(writer, state);
+
+	if (keyframe) {
+		writer.write(structure.data(), structure.size());
+		writer.writeVarint(current.size());
+		EntityID lastId = 0;
+		for (auto& entity : current) {
+			writer.writeVarint(entity.id - lastId);
+			writer.write(entity.bytes.data(), entity.bytes.size());
+			lastId = entity.id;
+		}
+	} else {
+		bool structureChanged = structure != previousStructure;
+		writer.write((uint8_t)structureChanged);
+		if (structureChanged) {
+			writer.write(structure.data(), structure.size());
+		}
+
+		// Both lists are sorted by id, walk them side by side
+		std::vector<const EncodedEntity*> destroyedEntities, createdEntities;
+		std::vector<std::pair<const EncodedEntity*, uint8_t>> changedEntities;
+		size_t p = 0;
+		size_t c = 0;
+		while (p < previous.size() || c < current.size()) {
+			if (c == current.size() || (p < previous.size() && previous[p].id < current[c].id)) {
+				destroyedEntities.push_back(&previous[p++]);
+			} else if (p == previous.size() || current[c].id < previous[p].id) {
+				createdEntities.push_back(&current[c++]);
+			} else {
+				auto& before = previous[p++];
+				auto& after = current[c++];
+				uint8_t mask = 0;
+				for (size_t section = 0; section < entitySectionCount; section++) {
+					auto beforeBegin = before.bytes.begin() + before.sections[section];
+					auto beforeEnd = before.bytes.begin() + before.sections[section + 1];
+					auto afterBegin = after.bytes.begin() + after.sections[section];
+					auto afterEnd = after.bytes.begin() + after.sections[section + 1];
+					if (!std::equal(beforeBegin, beforeEnd, afterBegin, afterEnd)) {
+						mask |= 1 << section;
+					}
+				}
+				if (mask) {
+					changedEntities.emplace_back(&after, mask);
+				}
+			}
+		}
+
+		EntityID lastId = 0;
+		writer.writeVarint(destroyedEntities.size());
+		for (auto entity : destroyedEntities) {
+			writer.writeVarint(entity->id - lastId);
+			lastId = entity->id;
+		}
+		lastId = 0;
+		writer.writeVarint(createdEntities.size());
+		for (auto entity : createdEntities) {
+			writer.writeVarint(entity->id - lastId);
+			writer.write(entity->bytes.data(), entity->bytes.size());
+			lastId = entity->id;
+		}
+		lastId = 0;
+		writer.writeVarint(changedEntities.size());
+		for (auto& pair : changedEntities) {
+			auto entity = pair.first;
+			writer.writeVarint(entity->id - lastId);
+			writer.write(pair.second);
+			for (size_t section = 0; section < entitySectionCount; section++) {
+				if (pair.second & (1 << section)) {
+					writer.write(entity->bytes.data() + entity->sections[section], entity->sections[section + 1] - entity->sections[section]);
+				}
+			}
+			lastId = entity->id;
+		}
+	}
+	blockTicks++;
+
+	std::swap(previous, current);
+	std::swap(previousStructure, structure);
+}
+
+void StateRecorder::finishBlock() {
+	// The names of the clips the block uses first go along with it
+	blockHeader.clear();
+	SnapshotWriter writer(blockHeader);
+	writer.write((int32_t)blockFirstTick);
+	writer.write((int32_t)blockTicks);
+	writer.write((uint32_t)0);
+	writer.write((uint32_t)block.size());
+	writer.writeVarint(clipNames.size() - writtenClips);
+	for (; writtenClips < clipNames.size(); writtenClips++) {
+		writer.writeString(clipNames[writtenClips]);
+	}
+	uint32_t namesSize = (uint32_t)(blockHeader.size() - blockHeaderSize);
+	std::memcpy(blockHeader.data() + 2 * sizeof(uint32_t), &namesSize, sizeof(namesSize));
+
+	// Flushed right away, a session that ends without closing the file loses only the block being recorded
+	file.write((const char*)blockHeader.data(), blockHeader.size());
+	file.write((const char*)block.data(), block.size());
+	file.flush();
+	offset += blockHeader.size() + block.size();
+	block.clear();
+	blockTicks = 0;
+}
+
+static std::vector<uint8_t> readBytes(std::ifstream& file, uint64_t offset, size_t size) {
+	std::vector<uint8_t> bytes(size);
+	file.seekg(offset);
+	if (!file.read((char*)bytes.data(), size)) {
+		throw std::runtime_error("State recording is truncated");
+	}
+	return bytes;
+}
+
+StateRecording::StateRecording(const std::string& path, const Assets& assets)
+	: file(path, std::ios::binary | std::ios::ate) {
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open state recording " + path);
+	}
+	uint64_t fileSize = (uint64_t)file.tellg();
+	if (fileSize < fileHeaderSize) {
+		throw std::runtime_error(path + " is not a state recording");
+	}
+
+	auto fileHeaderBytes = readBytes(file, 0, fileHeaderSize);
+	SnapshotReader fileHeader(fileHeaderBytes);
+	if (fileHeader.read<uint32_t>() != stateRecordingMagic || fileHeader.read<uint32_t>() != stateRecordingVersion) {
+		throw std::runtime_error(path + " is not a state recording of this version");
+	}
+	uint32_t replayHeaderSize = fileHeader.read<uint32_t>();
+	if (replayHeaderSize > fileSize - fileHeaderSize) {
+		throw std::runtime_error(path + " is truncated");
+	}
+	auto headerBytes = readBytes(file, fileHeaderSize, replayHeaderSize);
+	SnapshotReader headerReader(headerBytes);
+	readReplayHeader(headerReader, header);
+
+	// The index is built from the block headers, up to the last complete block
+	clips.push_back(nullptr);
+	uint64_t position = fileHeaderSize + replayHeaderSize;
+	while (fileSize - position >= blockHeaderSize) {
+		auto blockHeaderBytes = readBytes(file, position, blockHeaderSize);
+		SnapshotReader blockHeader(blockHeaderBytes);
+		StateBlock block;
+		block.firstTick = blockHeader.read<int32_t>();
+		block.tickCount = blockHeader.read<int32_t>();
+		uint32_t namesSize = blockHeader.read<uint32_t>();
+		block.size = blockHeader.read<uint32_t>();
+		block.offset = position + blockHeaderSize + namesSize;
+		if (block.offset + block.size > fileSize) {
+			break;
+		}
+
+		auto namesBytes = readBytes(file, position + blockHeaderSize, namesSize);
+		SnapshotReader names(namesBytes);
+		size_t clipCount = (size_t)names.readVarint();
+		for (size_t i = 0; i < clipCount; i++) {
+			std::string name;
+			names.readString(name);
+			auto handle = assets.findAnimation(name);
+			if (!handle.valid()) {
+				throw std::runtime_error(path + " uses the animation " + name + " which isn't loaded");
+			}
+			clips.push_back(&assets.getAnimation(handle));
+		}
+		index.push_back(block);
+		position = block.offset + block.size;
+	}
+}
+
+int StateRecording::getFirstTick() const {
+	return index.empty() ? -1 : index.front().firstTick;
+}
+
+int StateRecording::getLastTick() const {
+	return index.empty() ? -1 : index.back().firstTick + index.back().tickCount - 1;
+}
+
+const LevelState& StateRecording::seek(int target) {
+	if (index.empty() || target < getFirstTick() || target > getLastTick()) {
+		throw std::out_of_range("Tick " + std::to_string(target) + " isn't in the state recording");
+	}
+	// Binary search for the last block starting at or before the tick
+	auto next = std::upper_bound(index.begin(), index.end(), target, [](int tick, const StateBlock& block) {
+		return tick < block.firstTick;
+	});
+	size_t block = (size_t)(next - index.begin()) - 1;
+	if (block != loadedBlock || target < tick) {
+		loadBlock(block);
+		decodeKeyframe();
+		tick = index[block].firstTick;
+	}
+	while (tick < target) {
+		decodeDelta();
+		tick++;
+	}
+	return state;
+}
+
+void StateRecording::loadBlock(size_t block) {
+	// Only this block is read, the rest of the recording stays on disk
+	blockData = readBytes(file, index[block].offset, index[block].size);
+	reader = SnapshotReader(blockData);
+	loadedBlock = block;
+}
+
+void StateRecording::decodeScalars() {
+	state.frame = (int)reader.readVarint();
+	reader.read(state.time);
+	state.paused = reader.read<uint8_t>() != 0;
+	state.windowScroll = readVec2(reader);
+	state.previousWindowScroll = readVec2(reader);
+	state.entities.counter = (size_t)reader.readVarint();
+}
+
+void StateRecording::decodeStructure() {
+	reader.read(state.playerConfig.movementSpeed);
+	reader.read(state.playerConfig.jumpVelocity);
+	reader.read(state.playerConfig.maxSpeed);
+	reader.read(state.playerConfig.gravity);
+	reader.readString(state.playerConfig.bulletAnimation);
+
+	auto readIds = [&](std::vector<EntityID>& ids) {
+		ids.resize((size_t)reader.readVarint());
+		for (auto& id : ids) {
+			id = (EntityID)reader.readVarint();
+		}
+	};
+	readIds(state.players);
+	state.chunks.resize((size_t)reader.readVarint());
+	for (auto& chunk : state.chunks) {
+		chunk.first.x = reader.read<int32_t>();
+		chunk.first.y = reader.read<int32_t>();
+		readIds(chunk.second);
+	}
+	state.objectStates.resize((size_t)reader.readVarint());
+	for (auto& pair : state.objectStates) {
+		auto type = (LevelObject::Type)reader.read<uint8_t>();
+		auto x = reader.read<float>();
+		auto y = reader.read<float>();
+		pair.first = LevelObjectKey(type, x, y);
+		uint8_t bits = reader.read<uint8_t>();
+		pair.second.destroyed = bits & 1;
+		pair.second.usedCoinBox = bits & 2;
+	}
+}
+
+void StateRecording::decodeSection(size_t section, EntityState& entity) {
+	if (section == 0) {
+		uint8_t bits = reader.read<uint8_t>();
+		entity.dead = bits & 1;
+		entity.baby = bits & 2;
+		entity.tags = (uint32_t)reader.readVarint();
+		return;
+	}
+	size_t current = 1;
+	std::apply([&](auto&... components) {
+		((current++ == section ? decodeComponent(reader, components, clips) : void()), ...);
+	}, entity.components);
+}
+
+void StateRecording::decodeEntity(EntityState& entity) {
+	for (size_t section = 0; section < entitySectionCount; section++) {
+		decodeSection(section, entity);
+	}
+}
+
+void StateRecording::decodeKeyframe() {
+	decodeScalars();
+	decodeStructure();
+	auto& entities = state.entities.entities;
+	entities.resize((size_t)reader.readVarint());
+	EntityID id = 0;
+	for (auto& entity : entities) {
+		id += (EntityID)reader.readVarint();
+		entity.id = id;
+		decodeEntity(entity);
+	}
+}
+
+void StateRecording::decodeDelta() {
+	decodeScalars();
+	if (reader.read<uint8_t>()) {
+		decodeStructure();
+	}
+
+	destroyed.resize((size_t)reader.readVarint());
+	EntityID id = 0;
+	for (auto& destroyedId : destroyed) {
+		id += (EntityID)reader.readVarint();
+		destroyedId = id;
+	}
+	created.resize((size_t)reader.readVarint());
+	id = 0;
+	for (auto& entity : created) {
+		id += (EntityID)reader.readVarint();
+		entity.id = id;
+		decodeEntity(entity);
+	}
+
+	// Everything is sorted by id: drop the destroyed entities and merge in the created ones
+	auto& entities = state.entities.entities;
+	merged.clear();
+	merged.reserve(entities.size() + created.size());
+	size_t d = 0;
+	size_t c = 0;
+	for (auto& entity : entities) {
+		while (d < destroyed.size() && destroyed[d] < entity.id) {
+			d++;
+		}
+		if (d < destroyed.size() && destroyed[d] == entity.id) {
+			continue;
+		}
+		while (c < created.size() && created[c].id < entity.id) {
+			merged.push_back(std::move(created[c++]));
+		}
+		merged.push_back(std::move(entity));
+	}
+	while (c < created.size()) {
+		merged.push_back(std::move(created[c++]));
+	}
+	std::swap(entities, merged);
+
+	size_t changedCount = (size_t)reader.readVarint();
+	id = 0;
+	for (size_t i = 0; i < changedCount; i++) {
+		id += (EntityID)reader.readVarint();
+		uint8_t mask = reader.read<uint8_t>();
+		auto entity = std::lower_bound(entities.begin(), entities.end(), id, [](const EntityState& entity, EntityID id) {
+			return entity.id < id;
+		});
+		if (entity == entities.end() || entity->id != id) {
+			throw std::runtime_error("State recording changes an entity that doesn't exist");
+		}
+		for (size_t section = 0; section < entitySectionCount; section++) {
+			if (mask & (1 << section)) {
+				decodeSection(section, *entity);
+			}
+		}
+	}
+}
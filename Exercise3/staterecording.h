@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "assets.h"
+#include "replay.h"
+#include "scenes/playlevel.h"
+
+// Level states of a whole session on disk, to jump to any tick without simulating up to it.
+//
+// The file is a list of blocks, each a keyframe with the full state followed by the changes of every tick
+// until the next keyframe: entities created and destroyed, and the components that changed. Every block starts
+// with its ticks and size, the reader indexes them when opening the file, so seeking reads one block and decodes
+// at most a keyframe interval of changes. Blocks are written out as they finish, a recording stays readable up to
+// its last complete block when the session ends without closing it. Animation clips are stored by name,
+// recordings stay valid across runs.
+
+// Entities are stored as a header section (dead, baby, tags) followed by one section per component,
+// delta frames only carry the sections that changed
+constexpr size_t entitySectionCount = 1 + std::tuple_size_v<ComponentTuple>;
+static_assert(entitySectionCount <= 8, "Delta frames mark the changed sections of an entity in one byte");
+
+struct EncodedEntity
+{
+	EntityID id = 0;
+	std::vector<uint8_t> bytes;
+	std::array<uint32_t, entitySectionCount + 1> sections = {}; // start of each section, then the end
+};
+
+struct StateBlock
+{
+	int firstTick = 0;
+	int tickCount = 0;
+	uint64_t offset = 0;
+	uint32_t size = 0;
+};
+
+// FNV-1a over the state encoded field by field like in recordings, with animation clips by name. Unlike a checksum of a
+// LevelSnapshot it leaves out padding and pointers, so equal states give equal checksums in any process.
+// buffer is scratch space, reused between calls.
+uint64_t levelStateChecksum(const LevelState& state, std::vector<uint8_t>& buffer);
+
+class StateRecorder
+{
+public:
+	// Throws when the file can't be created. A keyframe is written every keyframeInterval ticks.
+	StateRecorder(const std::string& path, const ReplayHeader& header, int keyframeInterval);
+	// Writes the last block
+	~StateRecorder();
+
+	StateRecorder(const StateRecorder&) = delete;
+	StateRecorder& operator=(const StateRecorder&) = delete;
+
+	// State after the given tick, ticks have to follow each other
+	void record(int tick, const LevelState& state);
+	uint64_t getBytesWritten() const { return offset; }
+
+private:
+	void encode(const EntityState& entity, EncodedEntity& encoded);
+	uint32_t clipIndex(const Animation& animation);
+	void finishBlock();
+
+	std::ofstream file;
+	int keyframeInterval;
+	uint64_t offset = 0;
+	std::vector<uint8_t> block;
+	std::vector<uint8_t> blockHeader;
+	int blockFirstTick = 0;
+	int blockTicks = 0;
+	int lastTick = -1;
+
+	// Clips by the index their name has in the file, 0 stands for no clip
+	std::unordered_map<const AnimationClip*, uint32_t> clipIndices;
+	std::vector<std::string> clipNames;
+	size_t writtenClips = 1; // names written to the file so far, the empty name of 0 never is
+
+	// The previous tick's entities and structure, changes are found by comparing against them
+	std::vector<EncodedEntity> previous;
+	std::vector<EncodedEntity> current;
+	std::vector<uint8_t> structure;
+	std::vector<uint8_t> previousStructure;
+};
+
+class StateRecording
+{
+public:
+	// Reads the header and indexes the blocks, which are read when they are needed. Throws when the file isn't a
+	// state recording or uses animations the assets don't have.
+	StateRecording(const std::string& path, const Assets& assets);
+
+	const ReplayHeader& getHeader() const { return header; }
+	int getFirstTick() const;
+	int getLastTick() const;
+
+	// State after the given tick
+	const LevelState& seek(int tick);
+	// Tick of the state last returned by seek, -1 before the first seek
+	int getTick() const { return tick; }
+
+private:
+	void loadBlock(size_t block);
+	void decodeKeyframe();
+	void decodeDelta();
+	void decodeScalars();
+	void decodeEntity(EntityState& entity);
+	void decodeSection(size_t section, EntityState& entity);
+	void decodeStructure();
+
+	std::ifstream file;
+	ReplayHeader header;
+	std::vector<const AnimationClip*> clips; // by the index in the file, null for 0
+	std::vector<StateBlock> index;
+
+	size_t loadedBlock = SIZE_MAX;
+	std::vector<uint8_t> blockData;
+	SnapshotReader reader = SnapshotReader(nullptr, 0);
+	int tick = -1;
+	LevelState state;
+	// Scratch for applying delta frames
+	std::vector<EntityID> destroyed;
+	std::vector<EntityState> created;
+	std::vector<EntityState> merged;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads running submitted jobs in FIFO order
+class ThreadPool
+{
+public:
+	explicit ThreadPool(size_t threadCount = std::max(1u, std::thread::hardware_concurrency())) {
+		for (size_t i = 0; i < threadCount; i++) {
+			workers.emplace_back([this] { work(); });
+		}
+	}
+
+	// Runs the jobs that are still queued before joining the workers
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Exceptions thrown by the job are rethrown by the future's get()
+	template<typename F>
+	std::future<std::invoke_result_t<F>> submit(F&& job) {
+		using Result = std::invoke_result_t<F>;
+		// std::function requires a copyable callable, so the task is shared
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+		auto future = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push([task] { (*task)(); });
+		}
+		wake.notify_one();
+		return future;
+	}
+
+private:
+	void work() {
+		while (true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (jobs.empty()) {
+					return;
+				}
+				job = std::move(jobs.front());
+				jobs.pop();
+			}
+			job();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+};
@@ -0,0 +1,75 @@
+#include "transport.h"
+#include <stdexcept>
+
+UdpTransport::UdpTransport(unsigned short localPort, const std::string& peer)
+	: buffer(sf::UdpSocket::MaxDatagramSize) {
+	auto separator = peer.rfind(':');
+	if (separator == std::string::npos) {
+		throw std::runtime_error("Peer address has to be host:port, got " + peer);
+	}
+	peerAddress = sf::IpAddress(peer.substr(0, separator));
+	peerPort = (unsigned short)std::stoul(peer.substr(separator + 1));
+	if (peerAddress == sf::IpAddress::None) {
+		throw std::runtime_error("Failed to resolve peer " + peer);
+	}
+	if (socket.bind(localPort) != sf::Socket::Done) {
+		throw std::runtime_error("Failed to bind UDP port " + std::to_string(localPort));
+	}
+	socket.setBlocking(false);
+}
+
+void UdpTransport::send(const std::vector<uint8_t>& packet) {
+	// Packets are resent until acknowledged, a failed send is just another lost packet
+	socket.send(packet.data(), packet.size(), peerAddress, peerPort);
+}
+
+bool UdpTransport::receive(std::vector<uint8_t>& packet) {
+	while (true) {
+		size_t received = 0;
+		sf::IpAddress sender;
+		unsigned short senderPort = 0;
+		if (socket.receive(buffer.data(), buffer.size(), received, sender, senderPort) != sf::Socket::Done) {
+			return false;
+		}
+		// Ignore strays from anyone but the peer
+		if (sender == peerAddress && senderPort == peerPort) {
+			packet.assign(buffer.begin(), buffer.begin() + received);
+			return true;
+		}
+	}
+}
+
+FakeNetwork::FakeNetwork(int latency, int jitter, float loss, uint32_t seed)
+	: latency(latency)
+	, jitter(jitter)
+	, loss(loss)
+	, random(seed) {
+	endpoints[0] = std::make_unique<Endpoint>(*this, 0);
+	endpoints[1] = std::make_unique<Endpoint>(*this, 1);
+}
+
+Transport& FakeNetwork::endpoint(int index) {
+	return *endpoints[index];
+}
+
+void FakeNetwork::tick() {
+	now++;
+}
+
+void FakeNetwork::Endpoint::send(const std::vector<uint8_t>& packet) {
+	if (std::uniform_real_distribution<float>(0, 1)(network.random) < network.loss) {
+		return;
+	}
+	int delay = network.latency + (network.jitter > 0 ? std::uniform_int_distribution<int>(0, network.jitter)(network.random) : 0);
+	network.inboxes[1 - index].emplace(network.now + delay, packet);
+}
+
+bool FakeNetwork::Endpoint::receive(std::vector<uint8_t>& packet) {
+	auto& inbox = network.inboxes[index];
+	if (inbox.empty() || inbox.begin()->first > network.now) {
+		return false;
+	}
+	packet = std::move(inbox.begin()->second);
+	inbox.erase(inbox.begin());
+	return true;
+}
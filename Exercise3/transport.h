@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <SFML/Network.hpp>
+
+// Unreliable, unordered datagrams to a single peer. Never blocks.
+class Transport
+{
+public:
+	virtual ~Transport() = default;
+
+	virtual void send(const std::vector<uint8_t>& packet) = 0;
+	// Next packet that arrived, false when there is none
+	virtual bool receive(std::vector<uint8_t>& packet) = 0;
+};
+
+// Datagrams over a non-blocking UDP socket
+class UdpTransport : public Transport
+{
+public:
+	// Peer as "host:port", throws when the port can't be bound or the peer doesn't resolve
+	UdpTransport(unsigned short localPort, const std::string& peer);
+
+	void send(const std::vector<uint8_t>& packet);
+	bool receive(std::vector<uint8_t>& packet);
+
+private:
+	sf::UdpSocket socket;
+	sf::IpAddress peerAddress;
+	unsigned short peerPort = 0;
+	std::vector<uint8_t> buffer;
+};
+
+// Two endpoints connected in-process. Packets are delayed by a number of ticks and dropped at random,
+// with a fixed seed so a lossy session can be run again exactly the same.
+class FakeNetwork
+{
+public:
+	// Packets take latency to latency + jitter ticks, loss is the chance of a packet being dropped (0 to 1)
+	FakeNetwork(int latency, int jitter, float loss, uint32_t seed = 1);
+
+	FakeNetwork(const FakeNetwork&) = delete;
+	FakeNetwork& operator=(const FakeNetwork&) = delete;
+
+	// Endpoint 0 talks to endpoint 1 and the other way around
+	Transport& endpoint(int index);
+	// Advances the network clock by one tick
+	void tick();
+
+private:
+	class Endpoint : public Transport
+	{
+	public:
+		Endpoint(FakeNetwork& network, int index)
+			: network(network)
+			, index(index) {
+		}
+
+		void send(const std::vector<uint8_t>& packet);
+		bool receive(std::vector<uint8_t>& packet);
+
+	private:
+		FakeNetwork& network;
+		int index;
+	};
+
+	int latency;
+	int jitter;
+	float loss;
+	int now = 0;
+	std::mt19937 random;
+	std::unique_ptr<Endpoint> endpoints[2];
+	std::multimap<int, std::vector<uint8_t>> inboxes[2]; // by delivery tick
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest value from one producer thread to one consumer thread without blocking either.
+// The producer always has a buffer to write to, the consumer always has a complete buffer to read from,
+// and the third buffer is swapped between them. Intermediate values are dropped when the consumer is slow.
+template<typename T>
+class TripleBuffer
+{
+public:
+	// Producer side: buffer to fill in, holds whatever was written into it three publishes ago
+	T& write() {
+		return m_buffers[m_writeIndex];
+	}
+
+	// Producer side: make the write buffer available to the consumer
+	void publish() {
+		m_writeIndex = m_shared.exchange(m_writeIndex | dirtyBit, std::memory_order_acq_rel) & indexMask;
+	}
+
+	// Consumer side: grab the most recently published buffer, returns false if nothing new was published
+	bool fetch() {
+		if (!(m_shared.load(std::memory_order_relaxed) & dirtyBit)) {
+			return false;
+		}
+		m_readIndex = m_shared.exchange(m_readIndex, std::memory_order_acq_rel) & indexMask;
+		return true;
+	}
+
+	// Consumer side: buffer obtained by the last successful fetch()
+	const T& read() const {
+		return m_buffers[m_readIndex];
+	}
+
+private:
+	static constexpr uint8_t indexMask = 0b011;
+	static constexpr uint8_t dirtyBit = 0b100;
+
+	T m_buffers[3];
+	uint8_t m_writeIndex = 0;
+	uint8_t m_readIndex = 1;
+	std::atomic<uint8_t> m_shared = 2;
+};
@@ -20,16 +20,19 @@ struct CTransform
 
 struct CShape
 {
-	sf::CircleShape circle;
+	float radius;
+	int points;
+	sf::Color fill;
+	sf::Color outline;
+	float thickness;
 
-	CShape(float radius, int points, const sf::Color& fill, const sf::Color& outline, int thickness)
-		:circle(radius, points)
-	{
-		circle.setFillColor(fill);
-		circle.setOutlineColor(outline);
-		circle.setOutlineThickness(thickness);
-		circle.setOrigin(radius, radius);
-	}
+	CShape(float radius, int points, const sf::Color& fill, const sf::Color& outline, float thickness)
+		: radius(radius)
+		, points(points)
+		, fill(fill)
+		, outline(outline)
+		, thickness(thickness)
+	{}
 };
 
 struct CCollision
@@ -59,8 +59,10 @@ void Game::init(const std::string& configPath)
 				std::cerr << "Error: Failed to load font file!" << std::endl;
 				exit(-1);
 			}
-			m_text.setFont(m_font);
-			m_text.setFillColor(sf::Color(r, g, b));
+			sf::Color color(r, g, b);
+			m_scoreText.setup(m_font, characterSize, color);
+			m_pausedText.setup(m_font, characterSize, color, "Game paused. Your score: ");
+			prewarmGlyphs(m_font, characterSize);
 		}
 		if (instruction == "Player") {
 			/**
@@ -409,40 +411,37 @@ void Game::sRender()
 {
 	m_window.clear(sf::Color::Black);
 
-	// Render entities
-	for (auto entity : m_entities.getAll())
+	// Render entities, batched into a single draw call
+	m_shapes.clear();
+	for (auto& entity : m_entities.getAll())
 	{
 		if (entity->cShape)
 		{
-			auto ptr = entity->cShape.get();
-			sf::CircleShape& shape = entity->cShape->circle;
-
-			// Check if the position can be updated
+			vec2 position;
+			float angle = 0;
 			if (entity->cTransform) {
-				shape.setPosition(entity->cTransform->position);
-				shape.setRotation(to_degrees(entity->cTransform->angle));
+				position = entity->cTransform->position;
+				angle = entity->cTransform->angle;
 			}
-
-			m_window.draw(shape);
+			m_shapes.add(*entity->cShape, position, angle);
 		}
 	}
+	m_shapes.draw(m_window);
 
-	// Render UI
-	std::stringstream scoreText;
+	// Render UI, the text layout is only rebuilt when the score changes
 	if (m_paused) {
-		scoreText << "Game paused. Your score: " << m_score;
-		m_text.setString(scoreText.str());
-		auto rect = m_text.getLocalBounds();
+		m_pausedText.setValue(m_score);
+		auto& rect = m_pausedText.getBounds();
 		auto windowSize = m_window.getSize();
-		m_text.setPosition((windowSize.x - rect.width) / 2, 20);
+		m_pausedText.setPosition((windowSize.x - rect.width) / 2, 20);
+		m_window.draw(m_pausedText.getText());
 	} else {
-		scoreText << m_score;
-		m_text.setString(scoreText.str());
-		auto rect = m_text.getLocalBounds();
+		m_scoreText.setValue(m_score);
+		auto& rect = m_scoreText.getBounds();
 		auto playerPos = m_player->cTransform->position;
-		m_text.setPosition(playerPos.x - rect.width / 2, playerPos.y - rect.height / 2);
+		m_scoreText.setPosition(playerPos.x - rect.width / 2, playerPos.y - rect.height / 2);
+		m_window.draw(m_scoreText.getText());
 	}
-	m_window.draw(m_text);
 
 	// Swap buffers
 	m_window.display();
@@ -603,15 +602,15 @@ void Game::spawnEnemy()
 void Game::spawnSmallEnemies(std::shared_ptr<Entity> killedEnemy)
 {
 	float scale = 0.5f;
-	auto circle = killedEnemy->cShape->circle;
+	auto& shape = *killedEnemy->cShape;
 	auto transform = killedEnemy->cTransform;
 	auto pos = transform->position;
-	auto vertices = circle.getPointCount();
+	auto vertices = shape.points;
 	float childRotation = pi * 2 / vertices;
 	for (int index = 0; index < vertices; index++) {
 		auto velocity = vec2::up();
 		velocity.rotate(childRotation * index);
-		auto childOffset = vec2::up() * (circle.getRadius() * scale);
+		auto childOffset = vec2::up() * (shape.radius * scale);
 		childOffset.rotate(childRotation * index);
 		auto child = m_entities.create(Entity::EnemyChild);
 		child->cTransform = std::make_shared<CTransform>(
@@ -621,11 +620,11 @@ void Game::spawnSmallEnemies(std::shared_ptr<Entity> killedEnemy)
 			transform->twist * vertices
 		);
 		child->cShape = std::make_shared<CShape>(
-			circle.getRadius() * scale,
+			shape.radius * scale,
 			vertices,
-			circle.getFillColor(),
-			circle.getOutlineColor(),
-			circle.getOutlineThickness()
+			shape.fill,
+			shape.outline,
+			shape.thickness
 		);
 		child->cCollision = std::make_shared<CCollision>(killedEnemy->cCollision->radius * scale, CCollision::Wrap);
 		child->cLifespan = std::make_shared<CLifespan>(m_enemyConfig.L / vertices, m_currentFrame);
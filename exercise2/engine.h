@@ -2,6 +2,8 @@
 #include <SFML/Graphics.hpp>
 #include "entities.h"
 #include "geometry.h"
+#include "hud.h"
+#include "shapes.h"
 
 struct PlayerConfig { int SR, CR, FR, FG, FB, OR, OG, OB, OT, V; float S; };
 struct EnemyConfig { int SR, CR, OR, OG, OB, OT, vMin, vMax, L, SP; float sMin, sMax; };
@@ -15,7 +17,9 @@ class Game
 	bool m_killed = false;
 	EntityManager m_entities;
 	sf::Font m_font;
-	sf::Text m_text;
+	HudText m_scoreText;
+	HudText m_pausedText;
+	ShapeRenderer m_shapes;
 	PlayerConfig m_playerConfig;
 	EnemyConfig m_enemyConfig;
 	BulletConfig m_bulletConfig;
@@ -0,0 +1,50 @@
+#include "hud.h"
+
+void HudText::layout()
+{
+	if (!m_dirty) return;
+	m_text.setString(m_prefix + std::to_string(m_value));
+	m_bounds = m_text.getLocalBounds();
+	m_dirty = false;
+}
+
+void HudText::setup(const sf::Font& font, unsigned int characterSize, const sf::Color& color, const std::string& prefix)
+{
+	m_text.setFont(font);
+	m_text.setCharacterSize(characterSize);
+	m_text.setFillColor(color);
+	m_prefix = prefix;
+	m_dirty = true;
+}
+
+void HudText::setValue(int value)
+{
+	if (value != m_value) {
+		m_value = value;
+		m_dirty = true;
+	}
+}
+
+void HudText::setPosition(float x, float y)
+{
+	m_text.setPosition(x, y);
+}
+
+const sf::FloatRect& HudText::getBounds()
+{
+	layout();
+	return m_bounds;
+}
+
+const sf::Text& HudText::getText()
+{
+	layout();
+	return m_text;
+}
+
+void prewarmGlyphs(const sf::Font& font, unsigned int characterSize)
+{
+	for (sf::Uint32 character = ' '; character <= '~'; character++) {
+		font.getGlyph(character, characterSize, false);
+	}
+}
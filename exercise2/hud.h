@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <SFML/Graphics.hpp>
+
+/**
+ * Text showing a prefix followed by a number.
+ * The string and its layout are only rebuilt when the number actually changes.
+ */
+class HudText
+{
+	sf::Text m_text;
+	std::string m_prefix;
+	sf::FloatRect m_bounds;
+	int m_value = 0;
+	bool m_dirty = true;
+
+	void layout();
+
+public:
+	void setup(const sf::Font& font, unsigned int characterSize, const sf::Color& color, const std::string& prefix = "");
+	void setValue(int value);
+	void setPosition(float x, float y);
+	const sf::FloatRect& getBounds();
+	const sf::Text& getText();
+};
+
+// Rasterizes all printable ASCII glyphs up front, so new characters don't cause a hitch the first time they show up
+void prewarmGlyphs(const sf::Font& font, unsigned int characterSize);
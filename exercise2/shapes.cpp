@@ -0,0 +1,74 @@
+#include "shapes.h"
+
+const ShapeRenderer::Template& ShapeRenderer::getTemplate(const CShape& shape)
+{
+	TemplateKey key(shape.points, shape.radius, shape.thickness);
+	auto it = m_templates.find(key);
+	if (it != m_templates.end()) {
+		return it->second;
+	}
+
+	// Same point layout as sf::CircleShape: first point at the top, going clockwise
+	std::vector<vec2> inner(shape.points);
+	std::vector<vec2> outer(shape.points);
+	// Outline grows outward by the thickness measured along the edge normals
+	float outerRadius = shape.radius + shape.thickness / cosf(pi / shape.points);
+	for (int index = 0; index < shape.points; index++) {
+		float angle = index * 2 * pi / shape.points - pi / 2;
+		vec2 direction(cosf(angle), sinf(angle));
+		inner[index] = direction * shape.radius;
+		outer[index] = direction * outerRadius;
+	}
+
+	Template& result = m_templates[key];
+	for (int index = 0; index < shape.points; index++) {
+		int nextIndex = (index + 1) % shape.points;
+		result.fill.push_back(vec2::zero());
+		result.fill.push_back(inner[index]);
+		result.fill.push_back(inner[nextIndex]);
+
+		if (shape.thickness != 0) {
+			result.outline.push_back(inner[index]);
+			result.outline.push_back(outer[index]);
+			result.outline.push_back(inner[nextIndex]);
+			result.outline.push_back(inner[nextIndex]);
+			result.outline.push_back(outer[index]);
+			result.outline.push_back(outer[nextIndex]);
+		}
+	}
+	return result;
+}
+
+void ShapeRenderer::clear()
+{
+	m_vertices.clear();
+}
+
+void ShapeRenderer::add(const CShape& shape, const vec2& position, float angle)
+{
+	const Template& shapeTemplate = getTemplate(shape);
+	float cosAngle = cosf(angle);
+	float sinAngle = sinf(angle);
+	auto append = [&](const std::vector<vec2>& points, const sf::Color& color) {
+		for (auto& point : points) {
+			vec2 transformed(
+				position.x + point.x * cosAngle - point.y * sinAngle,
+				position.y + point.x * sinAngle + point.y * cosAngle
+			);
+			m_vertices.append(sf::Vertex(transformed, color));
+		}
+	};
+
+	// Fill and outline go right after each other so overlapping shapes keep their draw order
+	if (shape.fill.a > 0) {
+		append(shapeTemplate.fill, shape.fill);
+	}
+	if (shape.outline.a > 0) {
+		append(shapeTemplate.outline, shape.outline);
+	}
+}
+
+void ShapeRenderer::draw(sf::RenderTarget& target) const
+{
+	target.draw(m_vertices);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <map>
+#include <tuple>
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+#include "components.h"
+#include "geometry.h"
+
+/**
+ * Draws all CShape polygons in a single draw call.
+ * Every distinct (vertices, radius, outline thickness) combination is triangulated once and cached,
+ * each frame the cached triangles are transformed into one shared vertex array.
+ */
+class ShapeRenderer
+{
+	struct Template
+	{
+		// Triangle lists around the shape origin, at zero rotation
+		std::vector<vec2> fill;
+		std::vector<vec2> outline;
+	};
+
+	typedef std::tuple<int, float, float> TemplateKey;
+
+	std::map<TemplateKey, Template> m_templates;
+	sf::VertexArray m_vertices = sf::VertexArray(sf::Triangles);
+
+	const Template& getTemplate(const CShape& shape);
+
+public:
+	// Starts a new frame, keeps the vertex buffer allocation
+	void clear();
+	void add(const CShape& shape, const vec2& position, float angle);
+	void draw(sf::RenderTarget& target) const;
+};